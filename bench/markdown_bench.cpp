@@ -0,0 +1,360 @@
+// Throughput benchmarks for the rules and every pipeline stage.
+//
+//   MarkdownBench [--filter TEXT] [--min-time SECONDS] [--json FILE]
+//                 [--baseline FILE] [--threshold PERCENT] [--root DIR]
+//
+// Results are printed as a table on stderr and as JSON on stdout (or to
+// --json). With --baseline, every benchmark is compared to the same name in
+// a previously saved JSON file and the exit status is 1 when any of them got
+// slower by more than --threshold percent.
+#include "code_rule.h"
+#include "heading_rule.h"
+#include "horizontalline_rule.h"
+#include "html_escape.h"
+#include "inline_lexer.h"
+#include "input_file.h"
+#include "lexer.h"
+#include "link_rule.h"
+#include "list_rule.h"
+#include "output_sink.h"
+#include "parser.h"
+#include "renderer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef MARKDOWN_BENCH_ROOT
+#define MARKDOWN_BENCH_ROOT "."
+#endif
+
+// Keeps the compiler from dropping a computation whose result is unused.
+template <typename T>
+static void KeepAlive(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r"(&value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+struct Benchmark {
+    std::string name;
+    // Input bytes covered by one call of `run`.
+    size_t bytes;
+    std::function<void()> run;
+};
+
+struct Result {
+    std::string name;
+    size_t bytes;
+    uint64_t iterations;
+    double nsPerByte;
+    double mbPerSecond;
+};
+
+struct BenchOptions {
+    std::string filter;
+    double minTime = 0.5;
+    std::string jsonPath;
+    std::string baselinePath;
+    double threshold = 10.0;
+    std::string root = MARKDOWN_BENCH_ROOT;
+};
+
+// Repeats `text` until the result is at least `size` bytes.
+static std::string Repeat(std::string_view text, size_t size) {
+    std::string out;
+    out.reserve(size + text.size());
+    while (out.size() < size) {
+        out.append(text);
+    }
+    return out;
+}
+
+// TryParse is attempted at every offset of the input, continuing after what
+// each successful call consumed.
+static void AddRule(std::vector<Benchmark>& benchmarks, const std::string& name,
+                    const IRule& rule, std::string_view sample) {
+    auto input = std::make_shared<std::string>(Repeat(sample, 64 << 10));
+
+    benchmarks.push_back({"rule/" + name, input->size(), [&rule, input] {
+        size_t pos = 0;
+        while (pos < input->size()) {
+            std::optional<Token> token = rule.TryParse(*input, pos);
+            if (!token) {
+                ++pos;
+                continue;
+            }
+            KeepAlive(token);
+        }
+    }});
+}
+
+static std::vector<Benchmark> MakeBenchmarks(const std::vector<std::pair<std::string, std::string>>& files) {
+    static const CodeRule codeRule;
+    static const HeadingRule headingRule;
+    static const LinkRule linkRule;
+    static const ListRule listRule;
+    static const HorizontalRule horizontalRule;
+
+    std::vector<Benchmark> benchmarks;
+    AddRule(benchmarks, "code", codeRule, "call `render(doc)` then `flush()` ` \n");
+    AddRule(benchmarks, "heading", headingRule, "## A section heading\nplain line\n#not one\n");
+    AddRule(benchmarks, "link", linkRule, "see [the docs](https://example.com/docs) or [this] \n");
+    AddRule(benchmarks, "list", listRule, "- first item\n12. numbered item\n  * nested\nplain\n");
+    AddRule(benchmarks, "hr", horizontalRule, "---\n***\n___\n- - text\n");
+
+    // The whole corpus: the test documents, or a synthetic mix without them.
+    auto corpus = std::make_shared<std::string>();
+    for (const auto& file : files) {
+        corpus->append(file.second);
+    }
+    if (corpus->empty()) {
+        *corpus = Repeat("# Title\n\nSome *text* with **bold**, `code` and [a link](x).\n"
+                         "- item one\n- item two\n1. first\n\n---\nA <tag> & \"quote\"\n", 1 << 20);
+    }
+
+    auto prose = std::make_shared<std::string>(
+        Repeat("Plain words with *emphasis*, **strong**, `code` and [links](url) in between. ", 1 << 20));
+    benchmarks.push_back({"inline/tokenize", prose->size(), [prose] {
+        Document doc(*prose);
+        InlineLexer::Instance().Tokenize(*prose, doc);
+        KeepAlive(doc);
+    }});
+
+    // Emphasis has no rule: it is resolved from delimiter runs per block.
+    // The second input is full of unmatched delimiters, like snake_case
+    // identifiers in API docs.
+    auto emphasis = std::make_shared<std::string>(
+        Repeat("some *em* and **strong** with ***both*** or _under_ and *nested **deep** text* ", 1 << 20));
+    auto delimiters = std::make_shared<std::string>(
+        Repeat("call get_user_id or set_max_value_for * a ** b _ c __init__ ", 1 << 20));
+    for (auto& entry : {std::make_pair(std::string("emphasis"), emphasis),
+                        std::make_pair(std::string("unmatched"), delimiters)}) {
+        auto text = entry.second;
+        benchmarks.push_back({"inline/" + entry.first, text->size(), [text] {
+            Document doc(*text);
+            InlineLexer::Instance().Tokenize(*text, doc);
+            KeepAlive(doc);
+        }});
+    }
+
+    benchmarks.push_back({"lexer/tokenize", corpus->size(), [corpus] {
+        Lexer lexer;
+        Document doc = lexer.Tokenize(*corpus);
+        KeepAlive(doc);
+    }});
+
+    // Block structure only, as an outline or word count would lex it.
+    benchmarks.push_back({"lexer/blocks", corpus->size(), [corpus] {
+        Lexer lexer;
+        Document doc = lexer.TokenizeBlocks(*corpus);
+        KeepAlive(doc);
+    }});
+
+    auto doc = std::make_shared<Document>(Lexer().Tokenize(*corpus));
+    benchmarks.push_back({"parser/parse", corpus->size(), [corpus, doc] {
+        Parser parser;
+        BufferSink html(Parser::EstimateSize(*doc));
+        parser.Parse(*doc, html);
+        KeepAlive(html);
+    }});
+
+    auto clean = std::make_shared<std::string>(Repeat("nothing to escape in this line at all\n", 1 << 20));
+    auto dirty = std::make_shared<std::string>(Repeat("a < b && c > \"d\" or 'e'\n", 1 << 20));
+    for (auto& entry : {std::make_pair(std::string("clean"), clean), std::make_pair(std::string("dense"), dirty)}) {
+        auto text = entry.second;
+        benchmarks.push_back({"escape/" + entry.first, text->size(), [text] {
+            std::string out;
+            out.reserve(text->size() * 2);
+            EscapeHTML(*text, out);
+            KeepAlive(out);
+        }});
+    }
+
+    for (const auto& file : files) {
+        auto input = std::make_shared<std::string>(file.second);
+        benchmarks.push_back({"render/" + file.first, input->size(), [input] {
+            BufferSink html(Renderer::EstimateSize(input->size()));
+            Renderer().Render(*input, html);
+            KeepAlive(html);
+        }});
+    }
+
+    return benchmarks;
+}
+
+// Runs a benchmark in batches until minTime has passed and keeps the fastest
+// batch, which is the least disturbed by the rest of the machine.
+static Result Measure(const Benchmark& benchmark, double minTime) {
+    using Clock = std::chrono::steady_clock;
+
+    benchmark.run();
+
+    uint64_t batch = 1;
+    uint64_t iterations = 0;
+    double best = 0;
+    double elapsed = 0;
+    while (elapsed < minTime) {
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < batch; ++i) {
+            benchmark.run();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        elapsed += seconds;
+        iterations += batch;
+
+        double perCall = seconds / static_cast<double>(batch);
+        if (best == 0 || perCall < best) {
+            best = perCall;
+        }
+        // Aim for batches of about a tenth of the budget.
+        if (seconds < minTime / 10) {
+            batch *= 2;
+        }
+    }
+
+    double bytes = static_cast<double>(std::max<size_t>(benchmark.bytes, 1));
+    return Result{benchmark.name, benchmark.bytes, iterations, best * 1e9 / bytes, bytes / best / 1e6};
+}
+
+static std::string ToJson(const std::vector<Result>& results) {
+    std::ostringstream json;
+    json << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& result = results[i];
+        char line[512];
+        std::snprintf(line, sizeof(line),
+                      "    {\"name\": \"%s\", \"bytes\": %zu, \"iterations\": %llu, "
+                      "\"ns_per_byte\": %.6f, \"mb_per_s\": %.3f}%s\n",
+                      result.name.c_str(), result.bytes, static_cast<unsigned long long>(result.iterations),
+                      result.nsPerByte, result.mbPerSecond, i + 1 < results.size() ? "," : "");
+        json << line;
+    }
+    json << "  ]\n}\n";
+    return json.str();
+}
+
+// Reads name -> ns_per_byte from JSON written by ToJson.
+static bool LoadBaseline(const std::string& path, std::map<std::string, double>& baseline) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t name = line.find("\"name\": \"");
+        size_t cost = line.find("\"ns_per_byte\": ");
+        if (name == std::string::npos || cost == std::string::npos) {
+            continue;
+        }
+        name += 9;
+        size_t nameEnd = line.find('"', name);
+        baseline[line.substr(name, nameEnd - name)] = std::strtod(line.c_str() + cost + 15, nullptr);
+    }
+    return true;
+}
+
+static std::string ReadFile(const std::string& path) {
+    std::string error;
+    InputFile input;
+    if (!input.Open(path, error)) {
+        return std::string();
+    }
+    return std::string(input.Data());
+}
+
+static void PrintUsage() {
+    std::cerr << "Usage: MarkdownBench [--filter TEXT] [--min-time SECONDS] [--json FILE]\n"
+                 "                     [--baseline FILE] [--threshold PERCENT] [--root DIR]\n";
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            PrintUsage();
+            return 2;
+        }
+        std::string value = argv[++i];
+        if (arg == "--filter") {
+            options.filter = value;
+        } else if (arg == "--min-time") {
+            options.minTime = std::strtod(value.c_str(), nullptr);
+        } else if (arg == "--json") {
+            options.jsonPath = value;
+        } else if (arg == "--baseline") {
+            options.baselinePath = value;
+        } else if (arg == "--threshold") {
+            options.threshold = std::strtod(value.c_str(), nullptr);
+        } else if (arg == "--root") {
+            options.root = value;
+        } else {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    std::vector<std::pair<std::string, std::string>> files;
+    for (const char* name : {"test-1", "test-2"}) {
+        std::string content = ReadFile(options.root + "/target/" + name + ".md");
+        if (content.empty()) {
+            std::cerr << "warning: " << options.root << "/target/" << name << ".md not found, skipping\n";
+            continue;
+        }
+        files.emplace_back(name, std::move(content));
+    }
+
+    std::map<std::string, double> baseline;
+    if (!options.baselinePath.empty() && !LoadBaseline(options.baselinePath, baseline)) {
+        std::cerr << "error: cannot read baseline " << options.baselinePath << "\n";
+        return 2;
+    }
+
+    std::vector<Result> results;
+    size_t regressions = 0;
+    std::fprintf(stderr, "%-24s %12s %12s %10s\n", "benchmark", "MB/s", "ns/byte", "change");
+    for (const Benchmark& benchmark : MakeBenchmarks(files)) {
+        if (benchmark.name.find(options.filter) == std::string::npos) {
+            continue;
+        }
+
+        Result result = Measure(benchmark, options.minTime);
+        results.push_back(result);
+
+        char change[32] = "";
+        auto previous = baseline.find(result.name);
+        if (previous != baseline.end() && previous->second > 0) {
+            double percent = (result.nsPerByte / previous->second - 1) * 100;
+            bool regressed = percent > options.threshold;
+            regressions += regressed;
+            std::snprintf(change, sizeof(change), "%+.1f%%%s", percent, regressed ? " !" : "");
+        }
+        std::fprintf(stderr, "%-24s %12.1f %12.3f %10s\n", result.name.c_str(), result.mbPerSecond,
+                     result.nsPerByte, change);
+    }
+
+    std::string json = ToJson(results);
+    if (options.jsonPath.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream(options.jsonPath) << json;
+    }
+
+    if (regressions != 0) {
+        std::fprintf(stderr, "%zu benchmark(s) regressed by more than %.1f%%\n", regressions, options.threshold);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef BUILD_CACHE_H
+#define BUILD_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// On-disk record of what each output file was built from. An output is
+// fresh when its entry holds the same key (input bytes, engine version and
+// document shell) and the file on disk still has the recorded size and
+// content hash, so an unchanged document is skipped without rendering or
+// writing anything, while an output rewritten by anything else is not.
+class BuildCache {
+public:
+  // configHash covers everything besides the input that affects the output.
+  BuildCache(std::string directory, uint64_t configHash)
+    : directory(std::move(directory)), configHash(configHash) {}
+
+  // Creates the cache directory when needed.
+  bool Open(std::string& error);
+
+  uint64_t Key(std::string_view input) const;
+  bool IsFresh(const std::string& outputPath, uint64_t key) const;
+  // Records that outputPath now holds the output for key.
+  void Record(const std::string& outputPath, uint64_t key) const;
+  // Drops the entry for an output written without a key, e.g. streamed.
+  void Forget(const std::string& outputPath) const;
+
+private:
+  std::string EntryPath(const std::string& outputPath) const;
+
+  std::string directory;
+  uint64_t configHash;
+};
+
+#endif // BUILD_CACHE_H
@@ -0,0 +1,14 @@
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// 64-bit XXH64 hash of data; fast enough to run over every input file.
+uint64_t Hash64(std::string_view data, uint64_t seed = 0);
+
+// Fixed-width lowercase hex, as used in cache file names and entries.
+std::string ToHex(uint64_t value);
+
+#endif // CONTENT_HASH_H
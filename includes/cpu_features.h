@@ -0,0 +1,36 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// Run-time detection of the x86 vector extensions the SIMD kernels use.
+// Kernels are compiled with per-function target attributes, so the binary
+// still runs on CPUs without them.
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MARKDOWN_X86 1
+#endif
+
+inline bool CpuHasAVX2() {
+#ifdef MARKDOWN_X86
+  static const bool supported = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+  }();
+  return supported;
+#else
+  return false;
+#endif
+}
+
+inline bool CpuHasSSE2() {
+#ifdef MARKDOWN_X86
+  static const bool supported = [] {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2") != 0;
+  }();
+  return supported;
+#else
+  return false;
+#endif
+}
+
+#endif // CPU_FEATURES_H
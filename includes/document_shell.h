@@ -0,0 +1,41 @@
+#ifndef DOCUMENT_SHELL_H
+#define DOCUMENT_SHELL_H
+
+#include <string>
+#include <string_view>
+
+enum class ShellMode {
+  InlineStyle,  // stylesheet copied into a <style> element
+  LinkedStyle,  // <link rel="stylesheet"> pointing at the stylesheet
+  Fragment      // body HTML only, no document around it
+};
+
+// The HTML document around a rendered body. The template is filled in and
+// split into a prefix and a suffix once, then shared by every file; output
+// is written as prefix, body and suffix with a single gather write.
+class DocumentShell {
+public:
+  // The built-in template; {{head}} and {{body}} are the placeholders.
+  static const char* DefaultTemplate();
+
+  // Builds the shell from a template (the built-in one when templatePath is
+  // empty). `stylesheet` is read for InlineStyle and used as the href for
+  // LinkedStyle. Returns false and fills `error` when a file is unreadable.
+  bool Load(ShellMode mode, const std::string& stylesheet, const std::string& templatePath, std::string& error);
+
+  std::string_view Prefix() const { return prefix; }
+  std::string_view Suffix() const { return suffix; }
+  ShellMode Mode() const { return mode; }
+
+  // Writes prefix, body and suffix to fd, retrying partial writes.
+  bool Write(int fd, std::string_view body) const;
+  // Creates or truncates path and writes the whole document to it.
+  bool WriteFile(const std::string& path, std::string_view body) const;
+
+private:
+  ShellMode mode = ShellMode::Fragment;
+  std::string prefix;
+  std::string suffix;
+};
+
+#endif // DOCUMENT_SHELL_H
@@ -0,0 +1,150 @@
+#ifndef FILE_PIPELINE_H
+#define FILE_PIPELINE_H
+
+#include "document_shell.h"
+#include "input_file.h"
+#include "io_ring.h"
+#include "metrics.h"
+#include "worker_pool.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// One file on its way through a FilePipeline.
+struct FileJob {
+  std::string input;
+  std::string output;
+
+  // Reader stage: the input, or why it could not be read.
+  InputFile file;
+  bool readOk = false;
+  std::string error;
+
+  // Render stage: the body to write. Nothing is written unless `write` is
+  // set; `upToDate` marks a file that was skipped on purpose.
+  std::string html;
+  bool write = false;
+  bool upToDate = false;
+  // Free for the render stage, e.g. a cache key.
+  uint64_t key = 0;
+
+  // Writer stage.
+  bool written = false;
+  // Read and Write are filled in when the pipeline times stages.
+  FileMetrics metrics;
+  std::optional<StageClock> started;
+
+  // Runs on the writer thread once the job has left the pipeline.
+  std::function<void(FileJob&)> done;
+};
+
+// Overlaps reading, rendering and writing of many files. A reader thread
+// opens the files in the order they were added, with the next few already
+// read ahead by the kernel; the pool renders them; a writer thread writes
+// whatever is ready, prefix, body and suffix in one gather write per file.
+// Files that have been read but not yet written are capped in count and in
+// bytes, so a slow disk or a slow renderer stalls the reader instead of
+// filling memory.
+//
+// With io_uring, each stage instead batches its system calls: the reader
+// stats the files it reads ahead in one batch and opens, reads and closes
+// the small ones in another; the writer opens, writes and closes every file
+// that is ready in one go, with the shell's prefix and suffix in registered
+// buffers. Anything the ring cannot handle takes the plain path.
+class FilePipeline {
+public:
+  using RenderStage = std::function<void(FileJob&)>;
+
+  struct Limits {
+    // Files past the current one that get posix_fadvise(WILLNEED).
+    size_t readAhead = 16;
+    // Input plus estimated output of files in flight. A single larger file
+    // still goes through, on its own.
+    uint64_t maxBytes = 256ull << 20;
+    // 0 means four per worker.
+    size_t maxFiles = 0;
+    // Batch file I/O through io_uring when the build and kernel allow it.
+    bool ioRing = true;
+  };
+
+  // render runs on the pool for every file that was read.
+  FilePipeline(const DocumentShell& shell, WorkerPool& pool, RenderStage render, Limits limits, bool timeStages = false);
+  // Finishes every added job.
+  ~FilePipeline();
+
+  FilePipeline(const FilePipeline&) = delete;
+  FilePipeline& operator=(const FilePipeline&) = delete;
+
+  // Never blocks, so pool tasks may add files while the pool renders.
+  void Add(std::unique_ptr<FileJob> job);
+  // Waits until every job added so far has been written and completed.
+  void Finish();
+
+  bool UsesIoRing() const { return usesIoRing; }
+
+private:
+  struct Pending {
+    std::unique_ptr<FileJob> job;
+    int fd = -1;
+    uint64_t size = 0;
+    bool regular = false;
+    // Budget held from admission until the job is written.
+    uint64_t charge = 0;
+  };
+
+  void ReadLoop();
+  void WriteLoop();
+  // Opens the file and starts kernel read-ahead on it.
+  static void Prefetch(Pending& pending);
+  // Prefetches window[from..], or stats it in one ring batch.
+  void Prefetch(std::deque<Pending>& window, size_t from);
+  // Takes budget for the longest prefix of the window that fits, waiting
+  // until at least the first file does. Returns the prefix length.
+  size_t Admit(std::deque<Pending>& window);
+  // Reads the first count files of the window.
+  void Read(std::deque<Pending>& window, size_t count);
+  void ReadThroughRing(std::deque<Pending>& window, const std::vector<size_t>& files);
+  void Write(std::deque<std::pair<std::unique_ptr<FileJob>, uint64_t>>& batch);
+  void WriteThroughRing(const std::vector<FileJob*>& jobs);
+  // Hands a job to the writer; charge is what it holds of the budget.
+  void Enqueue(std::unique_ptr<FileJob> job, uint64_t charge);
+
+  const DocumentShell& shell;
+  WorkerPool& pool;
+  RenderStage render;
+  Limits limits;
+  bool timeStages;
+
+  // Each ring is used by one stage thread only.
+  IoRing readRing;
+  IoRing writeRing;
+  bool usesIoRing = false;
+  int prefixBuffer = -1;
+  int suffixBuffer = -1;
+
+  std::mutex mutex;
+  // The reader waits for files and budget, the writer for rendered files,
+  // Finish() for the last job to complete.
+  std::condition_variable readable;
+  std::condition_variable writable;
+  std::condition_variable drained;
+  std::deque<std::unique_ptr<FileJob>> added;
+  std::deque<std::pair<std::unique_ptr<FileJob>, uint64_t>> ready;
+  uint64_t bytesInFlight = 0;
+  size_t filesInFlight = 0;
+  // Jobs added and not yet completed.
+  size_t unfinished = 0;
+  bool stopping = false;
+
+  std::thread reader;
+  std::thread writer;
+};
+
+#endif // FILE_PIPELINE_H
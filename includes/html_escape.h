@@ -0,0 +1,24 @@
+#ifndef HTML_ESCAPE_H
+#define HTML_ESCAPE_H
+
+#include "output_sink.h"
+#include <string>
+#include <string_view>
+
+// Position of the first byte of text at or after `from` that HTML-escaping
+// would replace (< > & " '), or text.size() when there is none. Scans 32 or
+// 16 bytes at a time on AVX2/SSE2 CPUs.
+size_t FindEscapable(std::string_view text, size_t from = 0);
+
+inline bool NeedsEscaping(std::string_view text) {
+  return FindEscapable(text) != text.size();
+}
+
+// Writes text to out with HTML special characters replaced. Clean spans are
+// written in one piece, so text with nothing to escape is a single write.
+void EscapeHTML(std::string_view text, OutputSink& out);
+
+// Appends the escaped text to a caller-owned buffer.
+void EscapeHTML(std::string_view text, std::string& out);
+
+#endif // HTML_ESCAPE_H
@@ -0,0 +1,54 @@
+#ifndef INCREMENTAL_RENDERER_H
+#define INCREMENTAL_RENDERER_H
+
+#include "lexer.h"
+#include "output_sink.h"
+#include "parser.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Keeps a document lexed and rendered while it is being edited, as in an
+// editor preview. Every top-level block keeps its own HTML and the parser
+// state it was rendered in; an edit re-lexes the blocks around it and
+// re-renders them, plus any following blocks whose incoming state changed.
+// The concatenated output always equals rendering the whole source again.
+class IncrementalRenderer {
+public:
+  IncrementalRenderer() = default;
+  // Blocks point into the owned source; moving would leave them dangling.
+  IncrementalRenderer(const IncrementalRenderer&) = delete;
+  IncrementalRenderer& operator=(const IncrementalRenderer&) = delete;
+
+  void Load(std::string source);
+
+  // Replaces `removed` bytes at `offset` by `text` and brings the document
+  // and HTML up to date. Returns the number of blocks rendered again.
+  // Throws std::out_of_range when offset is past the end of the source.
+  size_t Apply(size_t offset, size_t removed, std::string_view text);
+
+  std::string_view Source() const { return source; }
+  const Document& Doc() const { return doc; }
+
+  void Write(OutputSink& out) const;
+  std::string Html() const;
+
+private:
+  struct Block {
+    uint32_t node;
+    ParseState before;
+    std::string html;
+  };
+
+  // Renders blocks[from...] until a block is reached whose stored incoming
+  // state matches; returns how many blocks were rendered.
+  size_t RenderFrom(size_t from, size_t through);
+
+  std::string source;
+  Document doc;
+  Lexer lexer;
+  Parser parser;
+  std::vector<Block> blocks;
+};
+
+#endif // INCREMENTAL_RENDERER_H
@@ -0,0 +1,40 @@
+#ifndef INLINE_LEXER_H
+#define INLINE_LEXER_H
+
+#include "lexer.h"
+#include "structural_index.h"
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// Tokenizes the inline content of a block (text runs, headings, list items).
+// Code spans, links and rules come from a compile-time RulePipeline; emphasis
+// is resolved from '*' and '_' delimiter runs as in CommonMark, so it nests
+// and never rescans the block.
+// The dispatch table is built once and never modified afterwards, so the
+// shared instance can be used from any number of threads at the same time.
+class InlineLexer {
+public:
+  static const InlineLexer& Instance();
+
+  // Appends the inline tokens of input to doc; input must be a slice of
+  // doc.Source().
+  void Tokenize(std::string_view input, Document& doc) const;
+  // Same, but jumps between candidates using the stage 1 index of the
+  // document's source.
+  void Tokenize(std::string_view input, Document& doc, const StructuralIndex& index) const;
+
+  // Set in dispatch for the emphasis delimiters '*' and '_'.
+  static constexpr uint8_t kDelimiter = 0x80;
+
+private:
+  InlineLexer();
+
+  void Tokenize(std::string_view input, Document& doc, const StructuralIndex* index) const;
+
+  // Bit i is set when inline rule i can start on that byte; 0 means plain
+  // text.
+  std::array<uint8_t, 256> dispatch{};
+};
+
+#endif // INLINE_LEXER_H
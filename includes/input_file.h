@@ -0,0 +1,44 @@
+#ifndef INPUT_FILE_H
+#define INPUT_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only bytes of an input file. Regular files are memory-mapped and
+// handed to the lexer without a copy; pipes and other special files are
+// read once into a single owned buffer.
+class InputFile {
+public:
+  InputFile() = default;
+  ~InputFile();
+
+  InputFile(const InputFile&) = delete;
+  InputFile& operator=(const InputFile&) = delete;
+  InputFile(InputFile&& other) noexcept;
+  InputFile& operator=(InputFile&& other) noexcept;
+
+  // Returns false and fills `error` when the file cannot be read. With
+  // populate, every page is read in before returning, so the disk wait
+  // happens here and not on whichever thread touches Data() first.
+  bool Open(const std::string& path, std::string& error, bool populate = false);
+  // Same, from a descriptor the caller keeps open; `path` is only used in
+  // errors.
+  bool Open(int fd, const std::string& path, std::string& error, bool populate = false);
+
+  // Takes bytes that were read some other way.
+  void Assign(std::string data);
+
+  std::string_view Data() const { return mapping != nullptr ? std::string_view(static_cast<const char*>(mapping), mappedSize) : std::string_view(buffer); }
+  bool IsMapped() const { return mapping != nullptr; }
+
+private:
+  bool ReadAll(int fd, size_t sizeHint, std::string& error);
+  void Release();
+
+  void* mapping = nullptr;
+  size_t mappedSize = 0;
+  std::string buffer;
+};
+
+#endif // INPUT_FILE_H
@@ -0,0 +1,88 @@
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+struct statx;
+
+// A Linux io_uring instance driven with raw system calls, for batching the
+// opens, reads, writes and closes of many small files into a few kernel
+// entries. Built with the CMake option MARKDOWN_IO_URING; without it, or
+// when the kernel or a sandbox refuses io_uring, Open() fails and callers
+// use plain system calls instead.
+//
+// Operations are queued and then run as one batch. Files are opened into
+// the ring's own descriptor slots, so an open, its reads or writes and its
+// close can be queued together as a chain; later links run even when an
+// earlier one failed, so a close is never skipped. One thread at a time.
+class IoRing {
+public:
+  struct Completion {
+    uint64_t tag;
+    // Bytes transferred or 0 on success, -errno on failure.
+    int32_t result;
+  };
+
+  IoRing() = default;
+  ~IoRing();
+
+  IoRing(const IoRing&) = delete;
+  IoRing& operator=(const IoRing&) = delete;
+
+  // Returns false and fills `error` when io_uring is unavailable.
+  bool Open(unsigned entries, unsigned fileSlots, std::string& error);
+  bool IsOpen() const { return ringFd >= 0; }
+  // Operations that fit in one batch.
+  unsigned Capacity() const { return sqEntries; }
+  unsigned FileSlots() const { return fileSlots; }
+
+  // Pins buffers for Write(..., buffer); index i is buffers[i]. They must
+  // stay alive and unchanged while the ring is open.
+  bool RegisterBuffers(const iovec* buffers, unsigned count, std::string& error);
+
+  // Queue an operation; false when the batch is full. With `link`, the next
+  // operation queued waits for this one.
+  bool Statx(const char* path, struct statx* out, uint64_t tag);
+  bool OpenAt(const char* path, int flags, mode_t mode, unsigned slot, uint64_t tag, bool link);
+  bool Read(unsigned slot, void* data, uint32_t size, uint64_t offset, uint64_t tag, bool link);
+  // buffer is the index of a registered buffer containing data, or -1.
+  bool Write(unsigned slot, const void* data, uint32_t size, uint64_t offset, uint64_t tag, bool link,
+             int buffer = -1);
+  bool Close(unsigned slot, uint64_t tag);
+
+  // Submits every queued operation and waits for all of them to complete.
+  // Completions come in no particular order. On failure the ring is closed.
+  bool Run(std::vector<Completion>& completions, std::string& error);
+
+private:
+  void* Next(uint8_t opcode, bool link);
+  void Shutdown();
+
+  int ringFd = -1;
+  unsigned sqEntries = 0;
+  unsigned fileSlots = 0;
+  unsigned queued = 0;
+
+  void* sqRing = nullptr;
+  size_t sqRingSize = 0;
+  void* cqRing = nullptr;
+  size_t cqRingSize = 0;
+  void* sqes = nullptr;
+  size_t sqesSize = 0;
+
+  unsigned* sqHead = nullptr;
+  unsigned* sqTail = nullptr;
+  unsigned* sqMask = nullptr;
+  unsigned* sqArray = nullptr;
+  unsigned* cqHead = nullptr;
+  unsigned* cqTail = nullptr;
+  unsigned* cqMask = nullptr;
+  void* cqes = nullptr;
+  unsigned localTail = 0;
+};
+
+#endif // IO_RING_H
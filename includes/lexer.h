@@ -7,10 +7,12 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include <cstdint>
+#include <memory>
 #include <string_view>
 #include <vector>
 
-enum class Type {
+enum class Type : uint8_t {
   Heading,
   Bold,
   Italic,
@@ -25,12 +27,12 @@ enum class Type {
   EndOfFile
 };
 
-
+// What a rule produces for one match. The views point into the lexed input;
+// pos/max are relative to the string the rule was given.
 struct Token {
   Type type;
   std::string_view value;
   std::string_view meta; // levels, meta data.
-  std::vector<Token> children;
   size_t pos;
   size_t max;
 
@@ -39,17 +41,116 @@ struct Token {
     : type(t), value(v), meta(m), pos(ps), max(max) {}
 };
 
+// One token of a Document. All offsets are 32-bit positions in the source.
+// Nodes are stored in document order and a node's children follow it
+// directly, so the first child of node i is i + 1 and `next` is the index
+// of its next sibling (for the last child: the one after its parent).
+struct Node {
+  uint32_t pos;
+  uint32_t max;
+  uint32_t value;
+  uint32_t valueLength;
+  uint32_t meta;
+  uint32_t metaLength : 24;
+  Type type : 8;
+  uint32_t next;
+};
+
+static_assert(sizeof(Node) == 28, "Node is meant to stay compact");
+
+// The lexed form of a markdown source: one contiguous array of nodes that
+// refer back into the source, which must outlive the document.
+class Document {
+public:
+  static constexpr uint32_t kMaxSourceSize = UINT32_MAX;
+  static constexpr uint32_t kMaxMetaSize = (1u << 24) - 1;
+
+  Document() = default;
+  explicit Document(std::string_view source) : source(source) {}
+
+  std::string_view Source() const { return source; }
+  const std::vector<Node>& Nodes() const { return nodes; }
+  uint32_t size() const { return static_cast<uint32_t>(nodes.size()); }
+  const Node& operator[](uint32_t index) const { return nodes[index]; }
+
+  std::string_view Value(const Node& node) const { return source.substr(node.value, node.valueLength); }
+  std::string_view Meta(const Node& node) const { return source.substr(node.meta, node.metaLength); }
+
+  bool HasChildren(uint32_t index) const { return nodes[index].next > index + 1; }
+  uint32_t FirstChild(uint32_t index) const { return index + 1; }
+  // Children of `index` are FirstChild(index) .. nodes[index].next (exclusive),
+  // stepping through each child's `next`.
+  uint32_t ChildrenEnd(uint32_t index) const { return nodes[index].next; }
+
+  // Set for documents from Lexer::TokenizeBlocks. Their headings, list items
+  // and text blocks have no children in Nodes(); Inlines() lexes them.
+  bool InlinesDeferred() const { return deferred != nullptr; }
+  // The inline nodes of top-level block `index` of a deferred document, as a
+  // document of their own over the same source: the children Tokenize would
+  // have nested under the block, in the same order. Lexed on first use and
+  // cached; safe to call from any number of threads. Only for deferred
+  // documents and top-level block indices.
+  const Document& Inlines(uint32_t index) const;
+
+  void Reserve(size_t count) { nodes.reserve(count); }
+  // Appends a leaf; offset is where the token's input starts in the source.
+  uint32_t Append(const Token& token, size_t offset = 0);
+  // Makes every node appended after `index` a child of it.
+  void Close(uint32_t index) { nodes[index].next = size(); }
+
+private:
+  friend class Lexer;
+  struct InlineCache;
+
+  uint32_t OffsetOf(std::string_view part) const;
+  // Replaces nodes [first, last) with all nodes of `replacement`, a document
+  // over the same (new) source, and moves every later node `shift` bytes.
+  void Splice(uint32_t first, uint32_t last, const Document& replacement, int64_t shift);
+
+  std::string_view source;
+  std::vector<Node> nodes;
+  // Shared by copies, which have the same nodes.
+  std::shared_ptr<InlineCache> deferred;
+};
+
+// A change to a source: `removed` bytes at `offset` were replaced by
+// `inserted` new bytes.
+struct Edit {
+  size_t offset;
+  size_t removed;
+  size_t inserted;
+};
+
+// Top-level nodes rewritten by Lexer::Retokenize: [first, oldEnd) of the
+// document before the edit became [first, newEnd) after it.
+struct BlockRange {
+  uint32_t first;
+  uint32_t oldEnd;
+  uint32_t newEnd;
+};
+
 class ILexer {
 public:
   virtual ~ILexer() = default;
-  virtual std::vector<Token> Tokenize(std::string_view input) = 0;
+  virtual Document Tokenize(std::string_view input) = 0;
 };
 
 class Lexer : public ILexer {
   public:
     Lexer() = default;
     ~Lexer() override = default;
-    std::vector<Token> Tokenize(std::string_view input) override;
+    // Inputs larger than Document::kMaxSourceSize throw std::length_error.
+    Document Tokenize(std::string_view input) override;
+    // Lexes the block structure only, for consumers such as outlines or
+    // word counts that never look inside most blocks. Inline content is
+    // lexed per block through Document::Inlines when it is first needed.
+    Document TokenizeBlocks(std::string_view input);
+
+    // Brings doc, lexed from the source before `edit`, up to date with
+    // `input`, the source after it. Only the blocks around the edit are lexed
+    // again, widened until the new tokens line up with old block boundaries;
+    // every later node is shifted in place.
+    BlockRange Retokenize(Document& doc, std::string_view input, const Edit& edit);
 };
 
-#endif // LEXER_H
\ No newline at end of file
+#endif // LEXER_H
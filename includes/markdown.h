@@ -0,0 +1,54 @@
+#ifndef MARKDOWN_H
+#define MARKDOWN_H
+
+/* C interface to the markdown engine, for rendering in-process.
+ *
+ * A context owns the reusable state for a series of renders: the output
+ * buffer, and optionally a worker pool for large documents. It is not
+ * thread-safe; use one context per thread. Output is the HTML body only,
+ * exactly what MarkdownEngine writes between <body> and </body>. */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct markdown_context markdown_context;
+
+typedef enum markdown_status {
+  MARKDOWN_OK = 0,
+  MARKDOWN_INVALID_ARGUMENT,
+  /* The caller's buffer was too small; the required size is reported. */
+  MARKDOWN_BUFFER_TOO_SMALL,
+  /* The input is 4 GiB or larger. */
+  MARKDOWN_TOO_LARGE,
+  MARKDOWN_OUT_OF_MEMORY,
+  MARKDOWN_INTERNAL_ERROR
+} markdown_status;
+
+const char* markdown_version(void);
+const char* markdown_status_string(markdown_status status);
+
+/* threads <= 1 renders on the calling thread; more starts a pool of that
+ * many workers that splits documents of 1 MiB and up. Returns NULL when
+ * out of memory. */
+markdown_context* markdown_context_new(unsigned threads);
+void markdown_context_free(markdown_context* context);
+
+/* Renders into the context's buffer. *html stays valid until the next
+ * render or free on the same context and is NUL-terminated. */
+markdown_status markdown_render(markdown_context* context, const char* input, size_t length, const char** html,
+                                size_t* html_length);
+
+/* Renders into a caller-provided buffer, without a terminating NUL.
+ * *written is the size of the HTML; with MARKDOWN_BUFFER_TOO_SMALL it is
+ * the capacity needed and the buffer holds a truncated prefix. */
+markdown_status markdown_render_into(markdown_context* context, const char* input, size_t length, char* out,
+                                     size_t capacity, size_t* written);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MARKDOWN_H */
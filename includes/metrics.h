@@ -0,0 +1,80 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Per-file stages of a batch run. Stages are timed only when metrics are
+// enabled; four clock reads per stage, wall and thread CPU time at its start
+// and end, is all it costs.
+enum class Stage : uint8_t { Read, Tokenize, Parse, Write, Count };
+constexpr size_t kStageCount = static_cast<size_t>(Stage::Count);
+
+const char* StageName(Stage stage);
+
+// Appends text as a quoted JSON string.
+void AppendJsonString(std::string& out, std::string_view text);
+
+struct StageTime {
+  uint64_t wallNs = 0;
+  uint64_t cpuNs = 0;
+
+  StageTime& operator+=(const StageTime& other) {
+    wallNs += other.wallNs;
+    cpuNs += other.cpuNs;
+    return *this;
+  }
+};
+
+// Wall clock and CPU time of the calling thread since construction.
+class StageClock {
+public:
+  StageClock();
+  StageTime Elapsed() const;
+
+private:
+  uint64_t wallStart;
+  uint64_t cpuStart;
+};
+
+struct FileMetrics {
+  std::string name;
+  uint64_t inputBytes = 0;
+  uint64_t outputBytes = 0;
+  uint64_t tokens = 0;
+  // Streamed files interleave every stage and only have a total.
+  bool streamed = false;
+  StageTime stages[kStageCount];
+  StageTime total;
+
+  StageTime& operator[](Stage stage) { return stages[static_cast<size_t>(stage)]; }
+  const StageTime& operator[](Stage stage) const { return stages[static_cast<size_t>(stage)]; }
+};
+
+enum class MetricsFormat { Off, JsonLines, Summary };
+
+// Collects FileMetrics from any thread. JsonLines writes one object per file
+// as soon as it is added; Summary keeps them for a table of totals and
+// p50/p95/p99 across files at the end of the run.
+class MetricsCollector {
+public:
+  MetricsCollector(MetricsFormat format, std::ostream& out) : format(format), out(out) {}
+
+  bool Enabled() const { return format != MetricsFormat::Off; }
+
+  void Add(FileMetrics metrics);
+  // Writes the summary table; does nothing in the other formats.
+  void Finish(double wallSeconds);
+
+private:
+  MetricsFormat format;
+  std::ostream& out;
+  std::mutex mutex;
+  std::vector<FileMetrics> files;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,102 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Append-only destination for rendered HTML. The parser writes every piece
+// of output straight into a sink, so no intermediate strings are built.
+class OutputSink {
+public:
+  virtual ~OutputSink() = default;
+  virtual void Write(std::string_view data) = 0;
+  // Pushes buffered output to its destination; a no-op for in-memory sinks.
+  virtual void Flush() {}
+
+  OutputSink& operator<<(std::string_view data) {
+    Write(data);
+    return *this;
+  }
+};
+
+// Collects the whole document in one growable buffer.
+class BufferSink : public OutputSink {
+public:
+  explicit BufferSink(size_t sizeHint = 0) { buffer.reserve(sizeHint); }
+
+  void Write(std::string_view data) override { buffer.append(data); }
+
+  const std::string& str() const { return buffer; }
+  std::string Take() { return std::move(buffer); }
+
+private:
+  std::string buffer;
+};
+
+// Writes to an open stdio stream; the stream's own buffering batches the
+// small writes. The sink does not close the stream.
+class FileSink : public OutputSink {
+public:
+  explicit FileSink(std::FILE* file) : file(file) {}
+  ~FileSink() override { Flush(); }
+
+  void Write(std::string_view data) override {
+    if (std::fwrite(data.data(), 1, data.size(), file) != data.size()) {
+      failed = true;
+    }
+    written += data.size();
+  }
+  void Flush() override {
+    if (std::fflush(file) != 0) {
+      failed = true;
+    }
+  }
+
+  bool Failed() const { return failed; }
+  // Bytes handed to the stream so far.
+  uint64_t Written() const { return written; }
+
+private:
+  std::FILE* file;
+  bool failed = false;
+  uint64_t written = 0;
+};
+
+// Hands output to a user callback in chunks of up to `chunkSize` bytes.
+class CallbackSink : public OutputSink {
+public:
+  using Callback = std::function<void(std::string_view)>;
+
+  explicit CallbackSink(Callback callback, size_t chunkSize = 64 * 1024)
+    : callback(std::move(callback)), chunkSize(chunkSize) {
+    buffer.reserve(chunkSize);
+  }
+  ~CallbackSink() override { Flush(); }
+
+  void Write(std::string_view data) override {
+    if (buffer.size() + data.size() > chunkSize) {
+      Flush();
+      if (data.size() >= chunkSize) {
+        callback(data);
+        return;
+      }
+    }
+    buffer.append(data);
+  }
+  void Flush() override {
+    if (!buffer.empty()) {
+      callback(buffer);
+      buffer.clear();
+    }
+  }
+
+private:
+  Callback callback;
+  size_t chunkSize;
+  std::string buffer;
+};
+
+#endif // OUTPUT_SINK_H
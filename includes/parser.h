@@ -2,33 +2,60 @@
 #define PARSER_H
 
 #include "lexer.h"
+#include "output_sink.h"
 #include <string>
-#include <vector>
+
+// Open elements carried from one part of a document to the next when a
+// document is rendered in pieces.
+struct ParseState {
+    bool inParagraph = false;
+    bool inList = false;
+    bool isOrderedList = false;
+    // The next text block is the rest of a paragraph that was cut in two.
+    bool continuesParagraph = false;
+
+    bool operator==(const ParseState& other) const {
+        return inParagraph == other.inParagraph && inList == other.inList &&
+               isOrderedList == other.isOrderedList && continuesParagraph == other.continuesParagraph;
+    }
+    bool operator!=(const ParseState& other) const { return !(*this == other); }
+};
 
 class IParser {
 public:
     virtual ~IParser() = default;
-    virtual std::string Parse(const std::vector<Token>& tokens) = 0;
+    virtual void Parse(const Document& doc, OutputSink& out) = 0;
 };
 
 class Parser : public IParser {
 public:
     Parser() = default;
     ~Parser() override = default;
-    
-    std::string Parse(const std::vector<Token>& tokens) override;
+
+    void Parse(const Document& doc, OutputSink& out) override;
+    // Renders doc as the next part of a larger document, starting from and
+    // updating `state`. Open elements are only closed when `last` is set.
+    void Parse(const Document& doc, OutputSink& out, ParseState& state, bool last);
+    // Renders the top-level node at `index` (a block or end of file) as if it
+    // followed the elements open in `state`, and updates `state`.
+    void ParseBlock(const Document& doc, uint32_t index, OutputSink& out, ParseState& state);
+    // Renders into one buffer reserved with EstimateSize().
+    std::string Parse(const Document& doc);
+
+    // Rough size of the HTML for doc, used to size output buffers up front.
+    static size_t EstimateSize(const Document& doc);
 
 private:
-    std::string RenderToken(const Token& token);
-    std::string ParseHeading(const Token& token);
-    std::string ParseBold(const Token& token);
-    std::string ParseItalic(const Token& token);
-    std::string ParseCode(const Token& token);
-    std::string ParseLink(const Token& token);
-    std::string ParseList(const Token& token);
-    std::string ParseText(const Token& token);
-    std::string EscapeHTML(std::string_view text);
+    void RenderToken(const Document& doc, uint32_t index, OutputSink& out);
+    void ParseHeading(const Document& doc, uint32_t index, OutputSink& out);
+    void ParseBold(const Document& doc, uint32_t index, OutputSink& out);
+    void ParseItalic(const Document& doc, uint32_t index, OutputSink& out);
+    void ParseCode(const Document& doc, uint32_t index, OutputSink& out);
+    void ParseLink(const Document& doc, uint32_t index, OutputSink& out);
+    void ParseList(const Document& doc, uint32_t index, OutputSink& out);
+    void ParseText(const Document& doc, uint32_t index, OutputSink& out);
+    void RenderChildren(const Document& doc, uint32_t index, OutputSink& out);
     bool IsOrderedList(std::string_view meta);
 };
 
-#endif
\ No newline at end of file
+#endif
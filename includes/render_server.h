@@ -0,0 +1,70 @@
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+#include "document_shell.h"
+#include "metrics.h"
+#include "worker_pool.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Long-running render service for MarkdownEngine --serve / --socket.
+//
+// Requests and responses are framed; integers are big-endian:
+//   request:  u32 length, then length bytes of markdown
+//   response: u32 status, u32 length, then length bytes of HTML (status 0)
+//             or of an error message
+// A client may send any number of requests without waiting. They render in
+// parallel on the pool, and the responses on a connection come back in
+// request order; responses that are ready together go out in one write.
+// At most a few requests per worker are in flight on a connection, so a
+// pipelining client has to read responses while it is still writing.
+// The HTML is the whole document from the shell, or only the body with
+// ShellMode::Fragment.
+enum class ServeStatus : uint32_t { Ok = 0, TooLarge = 1, Failed = 2 };
+
+class RenderServer {
+public:
+  // Requests larger than this get a TooLarge response and the connection
+  // is closed, since the rest of the frame is never read.
+  static constexpr uint32_t kDefaultMaxRequest = 64u << 20;
+
+  RenderServer(const DocumentShell& shell, WorkerPool& pool, MetricsCollector* metrics = nullptr,
+               uint32_t maxRequest = kDefaultMaxRequest);
+  ~RenderServer();
+
+  RenderServer(const RenderServer&) = delete;
+  RenderServer& operator=(const RenderServer&) = delete;
+
+  // Serves one connection, e.g. stdin and stdout, until the input ends or
+  // Stop() is called. Returns false and fills `error` on an I/O error.
+  bool ServeStream(int in, int out, std::string& error);
+  // Listens on a Unix socket and serves every connection on its own thread
+  // until Stop(). The socket file is removed again on return.
+  bool ServeSocket(const std::string& path, std::string& error);
+
+  // Stops reading requests; the ones already read are still rendered and
+  // answered before the Serve call returns. Async-signal-safe.
+  void Stop();
+
+  uint64_t Requests() const { return requests.load(std::memory_order_relaxed); }
+  uint64_t BytesIn() const { return bytesIn.load(std::memory_order_relaxed); }
+
+private:
+  class Connection;
+
+  // Waits until fd is readable; false once Stop() has been called.
+  bool WaitReadable(int fd);
+
+  const DocumentShell& shell;
+  WorkerPool& pool;
+  MetricsCollector* metrics;
+  uint32_t maxRequest;
+  // Stop() writes to wake[1], which wakes every poll() on wake[0].
+  int wake[2] = {-1, -1};
+  std::atomic<bool> stopping{false};
+  std::atomic<uint64_t> requests{0};
+  std::atomic<uint64_t> bytesIn{0};
+};
+
+#endif // RENDER_SERVER_H
@@ -0,0 +1,56 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include "metrics.h"
+#include "output_sink.h"
+#include "worker_pool.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Where Renderer::Render() spent its time. For a document rendered in
+// parallel the times are summed over chunks, so wall time can exceed the
+// elapsed time.
+struct RenderStats {
+  StageTime tokenize;
+  StageTime parse;
+  uint64_t tokens = 0;
+};
+
+// Lexes and renders a whole markdown document into a sink.
+//
+// With a pool, documents of at least `parallelThreshold` bytes are split
+// into chunks that are lexed and rendered in parallel and then written out
+// in order. The output is byte-identical to the serial path.
+class Renderer {
+public:
+  static constexpr size_t kDefaultParallelThreshold = 1 << 20;
+  // Bumped whenever the HTML for some input changes. 2: CommonMark emphasis.
+  static constexpr uint32_t kOutputVersion = 2;
+
+  explicit Renderer(WorkerPool* pool = nullptr, size_t parallelThreshold = kDefaultParallelThreshold)
+    : pool(pool), parallelThreshold(parallelThreshold) {}
+
+  // Fills `stats` when given; without it no clocks are read.
+  void Render(std::string_view input, OutputSink& out, RenderStats* stats = nullptr) const;
+
+  // Everything in this build that decides the HTML for an input: the output
+  // version and the rules compiled in. Output caches key on it.
+  static std::string Fingerprint();
+
+  // Rough size of the HTML for an input of the given size.
+  static size_t EstimateSize(size_t inputSize) { return inputSize + inputSize * 3 / 8; }
+
+  // Offsets where input can be cut into independently rendered chunks of
+  // about `target` bytes; always starts with 0 and ends with input.size().
+  static std::vector<size_t> SplitPoints(std::string_view input, size_t target);
+
+private:
+  static void RenderSerial(std::string_view input, OutputSink& out, RenderStats* stats);
+
+  WorkerPool* pool;
+  size_t parallelThreshold;
+};
+
+#endif // RENDERER_H
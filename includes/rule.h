@@ -1,14 +1,24 @@
 #ifndef RULE_H
 #define RULE_H
 
+#include <cstdint>
+#include <optional>
 #include <string_view>
 #include "lexer.h"
 
+// Emphasis is not an IRule; its id only names its row in RuleStats.
+enum class RuleId : uint8_t { Heading, List, Code, Link, HorizontalRule, Emphasis, Count };
+
+// Rules are stateless: one instance can be shared by every lexer and thread.
 class IRule {
 public:
   virtual ~IRule() = default;
-  virtual bool Match(std::string_view input, size_t pos) = 0;
-  virtual Token Parse(std::string_view input, size_t& pos) = 0;
+  // Every byte a match can start on; used to build the dispatch tables.
+  virtual std::string_view FirstBytes() const = 0;
+  virtual RuleId Id() const = 0;
+  // Parses the construct starting at pos in a single scan. On success pos
+  // moves past it; on failure pos is left alone and nothing is returned.
+  virtual std::optional<Token> TryParse(std::string_view input, size_t& pos) const = 0;
 };
 
-#endif // RULE_H
\ No newline at end of file
+#endif // RULE_H
@@ -0,0 +1,108 @@
+#ifndef RULE_PIPELINE_H
+#define RULE_PIPELINE_H
+
+#include "rule.h"
+#include "rule_stats.h"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+// Which rules the engine is built with. CMake sets these from the
+// MARKDOWN_RULE_* options; a rule that is compiled out never matches and
+// its syntax is lexed as plain text.
+#ifndef MARKDOWN_RULE_HEADING
+#define MARKDOWN_RULE_HEADING 1
+#endif
+#ifndef MARKDOWN_RULE_LIST
+#define MARKDOWN_RULE_LIST 1
+#endif
+#ifndef MARKDOWN_RULE_CODE
+#define MARKDOWN_RULE_CODE 1
+#endif
+#ifndef MARKDOWN_RULE_LINK
+#define MARKDOWN_RULE_LINK 1
+#endif
+#ifndef MARKDOWN_RULE_HR
+#define MARKDOWN_RULE_HR 1
+#endif
+#ifndef MARKDOWN_RULE_EMPHASIS
+#define MARKDOWN_RULE_EMPHASIS 1
+#endif
+
+// A fixed, ordered set of rules. The rule types are known here, so every
+// call goes straight to the final class and can be inlined; nothing is
+// dispatched through IRule. The first rule that matches wins.
+template <typename... Rules>
+class RulePipeline {
+public:
+  static constexpr size_t kSize = sizeof...(Rules);
+  static_assert(kSize <= 7, "candidate masks have room for seven rules");
+  // Candidate mask that tries every rule.
+  static constexpr uint8_t kAll = static_cast<uint8_t>((1u << kSize) - 1);
+
+  template <typename Rule>
+  using Prepend = RulePipeline<Rule, Rules...>;
+
+  // Bit i is set for every byte rule i can start on; 0 means no rule can.
+  static std::array<uint8_t, 256> Dispatch() {
+    std::array<uint8_t, 256> table{};
+    AddFirstBytes(table, std::index_sequence_for<Rules...>{});
+    return table;
+  }
+
+  // Tries the rules whose bits are set in candidates, in order. On success
+  // pos moves past the token; otherwise it is left alone.
+  static std::optional<Token> TryParse(uint8_t candidates, std::string_view input, size_t& pos) {
+    std::optional<Token> token;
+    TryEach(candidates, input, pos, token, std::index_sequence_for<Rules...>{});
+    return token;
+  }
+
+private:
+  static const std::tuple<Rules...>& Instances() {
+    static const std::tuple<Rules...> rules;
+    return rules;
+  }
+
+  template <size_t... I>
+  static void AddFirstBytes(std::array<uint8_t, 256>& table, std::index_sequence<I...>) {
+    (AddFirstBytes(table, std::get<I>(Instances()).FirstBytes(), static_cast<uint8_t>(1u << I)), ...);
+  }
+
+  static void AddFirstBytes(std::array<uint8_t, 256>& table, std::string_view bytes, uint8_t bit) {
+    for (char c : bytes) {
+      table[static_cast<unsigned char>(c)] |= bit;
+    }
+  }
+
+  template <size_t... I>
+  static void TryEach(uint8_t candidates, std::string_view input, size_t& pos, std::optional<Token>& token,
+                      std::index_sequence<I...>) {
+    (void)((((candidates >> I) & 1u) != 0 && (token = RuleTryParse(std::get<I>(Instances()), input, pos))) || ...);
+  }
+};
+
+// Builds a RulePipeline from the rules whose flag is set, keeping order:
+//   MakePipeline<RuleIf<MARKDOWN_RULE_CODE, CodeRule>, ...>::type
+template <bool Enabled, typename Rule>
+struct RuleIf {};
+
+template <typename... Slots>
+struct MakePipeline {
+  using type = RulePipeline<>;
+};
+
+template <typename Rule, typename... Rest>
+struct MakePipeline<RuleIf<true, Rule>, Rest...> {
+  using type = typename MakePipeline<Rest...>::type::template Prepend<Rule>;
+};
+
+template <typename Rule, typename... Rest>
+struct MakePipeline<RuleIf<false, Rule>, Rest...> {
+  using type = typename MakePipeline<Rest...>::type;
+};
+
+#endif // RULE_PIPELINE_H
@@ -0,0 +1,72 @@
+#ifndef RULE_STATS_H
+#define RULE_STATS_H
+
+#include "rule.h"
+#include <array>
+#include <cstdint>
+#include <ostream>
+
+// Per-rule call, hit, byte and time counters, compiled in with the CMake
+// option MARKDOWN_RULE_STATS. Every thread counts into its own table, so
+// counting never contends; tables are merged when they are read. Without
+// the option RuleTryParse is a plain call and nothing is counted.
+//
+// Emphasis is paired in a pass of its own rather than by a rule. Its row
+// counts one call per '*' or '_' run, a hit per run that became part of
+// emphasis, the run bytes as scanned, the delimiters used as consumed, and
+// the time spent pairing.
+struct RuleCounters {
+  uint64_t calls = 0;
+  uint64_t hits = 0;
+  // Bytes the rule looked at while searching ahead.
+  uint64_t bytesScanned = 0;
+  // Bytes covered by the tokens it returned.
+  uint64_t bytesConsumed = 0;
+  uint64_t ns = 0;
+};
+
+constexpr size_t kRuleCount = static_cast<size_t>(RuleId::Count);
+using RuleTable = std::array<RuleCounters, kRuleCount>;
+
+const char* RuleName(RuleId id);
+
+class RuleStats {
+public:
+  // The calling thread's counters for a rule.
+  static RuleCounters& Local(RuleId id);
+  // Sum over every thread so far. Call it while no thread is lexing, e.g.
+  // after the worker pool has drained.
+  static RuleTable Collect();
+  static void Report(std::ostream& out);
+  static uint64_t Now();
+
+  static void Scanned(RuleId id, size_t bytes) { Local(id).bytesScanned += bytes; }
+};
+
+#ifdef MARKDOWN_RULE_STATS
+#define MARKDOWN_RULE_SCANNED(id, bytes) RuleStats::Scanned(id, bytes)
+#else
+#define MARKDOWN_RULE_SCANNED(id, bytes) ((void)0)
+#endif
+
+// Called with the concrete rule type, so the call is direct and inlinable.
+template <typename Rule>
+inline std::optional<Token> RuleTryParse(const Rule& rule, std::string_view input, size_t& pos) {
+#ifdef MARKDOWN_RULE_STATS
+  uint64_t start = RuleStats::Now();
+  size_t from = pos;
+  std::optional<Token> token = rule.TryParse(input, pos);
+  RuleCounters& counters = RuleStats::Local(rule.Id());
+  counters.ns += RuleStats::Now() - start;
+  counters.calls++;
+  if (token) {
+    counters.hits++;
+    counters.bytesConsumed += pos - from;
+  }
+  return token;
+#else
+  return rule.TryParse(input, pos);
+#endif
+}
+
+#endif // RULE_STATS_H
@@ -5,26 +5,26 @@
 #include "lexer.h"
 #include <string_view>
 
-class CodeRule : public IRule {
+class CodeRule final : public IRule {
 public:
   CodeRule() = default;
   ~CodeRule() override = default;
   
-  bool Match(std::string_view input, size_t pos) override;
-  Token Parse(std::string_view input, size_t& pos) override;
+  std::string_view FirstBytes() const override;
+  RuleId Id() const override;
+  std::optional<Token> TryParse(std::string_view input, size_t& pos) const override;
 
 private:
-  bool IsCodeBlock(std::string_view input, size_t pos);
-  bool IsInlineCode(std::string_view input, size_t pos);
+  bool IsCodeBlock(std::string_view input, size_t pos) const;
   
-  Token ParseCodeBlock(std::string_view input, size_t& pos);
-  Token ParseInlineCode(std::string_view input, size_t& pos);
+  Token ParseCodeBlock(std::string_view input, size_t& pos) const;
+  std::optional<Token> ParseInlineCode(std::string_view input, size_t& pos) const;
   
-  size_t CountBackticks(std::string_view input, size_t pos);
-  std::string_view ExtractLanguage(std::string_view input, size_t start, size_t& end);
-  std::string_view ExtractCodeContent(std::string_view input, size_t start, size_t end);
+  size_t CountBackticks(std::string_view input, size_t pos) const;
+  std::string_view ExtractLanguage(std::string_view input, size_t start, size_t& end) const;
+  std::string_view ExtractCodeContent(std::string_view input, size_t start, size_t end) const;
   
-  bool IsAtLineStart(std::string_view input, size_t pos);
+  bool IsAtLineStart(std::string_view input, size_t pos) const;
 };
 
 #endif
\ No newline at end of file
@@ -5,17 +5,21 @@
 #include "lexer.h"
 #include <string_view>
 
-class HeadingRule : public IRule {
+class HeadingRule final : public IRule {
 public:
   HeadingRule() = default;
   ~HeadingRule() override = default;
   
-  bool Match(std::string_view input, size_t pos) override;
-  Token Parse(std::string_view input, size_t& pos) override;
+  std::string_view FirstBytes() const override;
+  RuleId Id() const override;
+  std::optional<Token> TryParse(std::string_view input, size_t& pos) const override;
+  // Whether a block of this kind starts at pos, without parsing it; used
+  // where only block boundaries matter.
+  bool Match(std::string_view input, size_t pos) const;
 
 private:
-  size_t CountHashes(std::string_view input, size_t pos);
-  std::string_view ExtractHeadingText(std::string_view input, size_t start, size_t& end);
+  size_t CountHashes(std::string_view input, size_t pos) const;
+  std::string_view ExtractHeadingText(std::string_view input, size_t start, size_t& end) const;
 };
 
 #endif // HEADING_RULE_H
\ No newline at end of file
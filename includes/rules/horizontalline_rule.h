@@ -5,18 +5,19 @@
 #include "lexer.h"
 #include <string_view>
 
-class HorizontalRule : public IRule {
+class HorizontalRule final : public IRule {
 public:
   HorizontalRule() = default;
   ~HorizontalRule() override = default;
   
-  bool Match(std::string_view input, size_t pos) override;
-  Token Parse(std::string_view input, size_t& pos) override;
+  std::string_view FirstBytes() const override;
+  RuleId Id() const override;
+  std::optional<Token> TryParse(std::string_view input, size_t& pos) const override;
 
 private:
-  bool IsAtLineStart(std::string_view input, size_t pos);
-  bool IsHorizontalRule(std::string_view input, size_t pos);
-  size_t CountCharacter(std::string_view input, size_t pos, char c);
+  bool IsAtLineStart(std::string_view input, size_t pos) const;
+  bool IsHorizontalRule(std::string_view input, size_t pos, size_t& end) const;
+  size_t CountCharacter(std::string_view input, size_t pos, char c) const;
 };
 
 #endif
\ No newline at end of file
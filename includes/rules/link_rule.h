@@ -5,23 +5,23 @@
 #include "lexer.h"
 #include <string_view>
 
-class LinkRule : public IRule {
+class LinkRule final : public IRule {
 public:
   LinkRule() = default;
   ~LinkRule() override = default;
   
-  bool Match(std::string_view input, size_t pos) override;
-  Token Parse(std::string_view input, size_t& pos) override;
+  std::string_view FirstBytes() const override;
+  RuleId Id() const override;
+  std::optional<Token> TryParse(std::string_view input, size_t& pos) const override;
 
 private:
-  bool HasValidLinkStructure(std::string_view input, size_t pos);
-  std::string_view ExtractLinkText(std::string_view input, size_t start, size_t& end);
-  std::string_view ExtractLinkUrl(std::string_view input, size_t start, size_t& end);
+  std::string_view ExtractLinkUrl(std::string_view input, size_t start, size_t& end) const;
   
-  size_t FindClosingBracket(std::string_view input, size_t start);
-  size_t FindClosingParen(std::string_view input, size_t start);
+  size_t FindClosingBracket(std::string_view input, size_t start) const;
+  // `plain` is cleared when the destination has spaces, '<' or escapes.
+  size_t FindClosingParen(std::string_view input, size_t start, bool& plain) const;
   
-  bool IsEscaped(std::string_view input, size_t pos);
+  bool IsEscaped(std::string_view input, size_t pos) const;
 };
 
 #endif
\ No newline at end of file
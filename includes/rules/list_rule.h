@@ -5,24 +5,28 @@
 #include "lexer.h"
 #include <string_view>
 
-class ListRule : public IRule {
+class ListRule final : public IRule {
 public:
   ListRule() = default;
   ~ListRule() override = default;
   
-  bool Match(std::string_view input, size_t pos) override;
-  Token Parse(std::string_view input, size_t& pos) override;
+  std::string_view FirstBytes() const override;
+  RuleId Id() const override;
+  std::optional<Token> TryParse(std::string_view input, size_t& pos) const override;
+  // Whether a block of this kind starts at pos, without parsing it; used
+  // where only block boundaries matter.
+  bool Match(std::string_view input, size_t pos) const;
 
 private:
-  bool IsUnorderedList(std::string_view input, size_t pos);
-  bool IsOrderedList(std::string_view input, size_t pos);
+  bool IsUnorderedList(std::string_view input, size_t pos) const;
+  bool IsOrderedList(std::string_view input, size_t pos) const;
   
-  std::string_view ExtractListContent(std::string_view input, size_t start, size_t& end);
-  std::string_view ExtractListMarker(std::string_view input, size_t pos, size_t& markerEnd);
+  std::string_view ExtractListContent(std::string_view input, size_t start, size_t& end) const;
+  std::string_view ExtractListMarker(std::string_view input, size_t pos, size_t& markerEnd) const;
   
-  bool IsAtLineStart(std::string_view input, size_t pos);
-  bool IsDigit(char c);
-  size_t CountLeadingSpaces(std::string_view input, size_t pos);
+  bool IsAtLineStart(std::string_view input, size_t pos) const;
+  bool IsDigit(char c) const;
+  size_t CountLeadingSpaces(std::string_view input, size_t pos) const;
 };
 
 #endif
\ No newline at end of file
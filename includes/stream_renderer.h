@@ -0,0 +1,35 @@
+#ifndef STREAM_RENDERER_H
+#define STREAM_RENDERER_H
+
+#include "output_sink.h"
+#include <cstdint>
+#include <string>
+
+// Renders markdown read incrementally from a file descriptor (a file, a
+// pipe or stdin). Input is read in chunks; whenever a complete run of
+// blocks is available it is lexed, rendered and written to the sink, so
+// HTML starts flowing before the input ends and memory stays bounded.
+//
+// Runs are cut at lines that start a heading or list item, where the output
+// is identical to rendering the whole document at once. A single text block
+// longer than `maxBlock` is cut at a line break and continued as the same
+// paragraph; only emphasis, links or code spans crossing that cut differ.
+class StreamRenderer {
+public:
+  static constexpr size_t kDefaultChunkSize = 1 << 20;
+  static constexpr size_t kDefaultMaxBlock = 16 << 20;
+
+  explicit StreamRenderer(size_t chunkSize = kDefaultChunkSize, size_t maxBlock = kDefaultMaxBlock)
+    : chunkSize(chunkSize), maxBlock(maxBlock) {}
+
+  // Reads fd to end of file. Returns false and fills `error` on a read error;
+  // whatever was rendered before the error has already been written.
+  // `bytesRead`, when given, receives the number of input bytes consumed.
+  bool Render(int fd, OutputSink& out, std::string& error, uint64_t* bytesRead = nullptr) const;
+
+private:
+  size_t chunkSize;
+  size_t maxBlock;
+};
+
+#endif // STREAM_RENDERER_H
@@ -0,0 +1,37 @@
+#ifndef STRUCTURAL_INDEX_H
+#define STRUCTURAL_INDEX_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Stage 1 of the lexer: a single pass over the whole input that records
+// every markdown-significant byte and every newline in two bitmaps. The
+// block and inline stages use it to jump between candidates instead of
+// visiting each byte of plain text.
+//
+// The scan runs on AVX2 or SSE2 when the CPU has them (checked at run time)
+// and falls back to a table-driven scalar loop otherwise.
+class StructuralIndex {
+public:
+  explicit StructuralIndex(std::string_view input);
+
+  // First significant byte at or after pos, or size() when there is none.
+  size_t NextStructural(size_t pos) const;
+  // First '\n' at or after pos, or size() when there is none.
+  size_t NextNewline(size_t pos) const;
+
+  size_t size() const { return length; }
+
+  // Name of the kernel selected for this CPU ("avx2", "sse2" or "scalar").
+  static const char* Kernel();
+
+private:
+  static size_t NextSet(const std::vector<uint64_t>& bits, size_t pos, size_t length);
+
+  size_t length;
+  std::vector<uint64_t> structural;
+  std::vector<uint64_t> newlines;
+};
+
+#endif // STRUCTURAL_INDEX_H
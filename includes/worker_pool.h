@@ -0,0 +1,88 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size thread pool with one task deque per worker. A worker takes
+// tasks from the front of its own deque and, once that is empty, steals
+// from the back of the others, so work submitted in priority order is
+// started in roughly that order while no worker sits idle.
+class WorkerPool {
+public:
+  using Task = std::function<void()>;
+
+  // threads == 0 means DefaultConcurrency().
+  explicit WorkerPool(size_t threads = 0);
+  // Finishes every submitted task before joining the workers.
+  ~WorkerPool();
+
+  WorkerPool(const WorkerPool&) = delete;
+  WorkerPool& operator=(const WorkerPool&) = delete;
+
+  // Tasks submitted from a worker go to that worker's deque; tasks from
+  // other threads are spread over the deques round-robin.
+  void Submit(Task task);
+  // Blocks until every submitted task has finished.
+  void Wait();
+  // Runs one queued task on the calling thread; false when none is queued.
+  bool RunOne();
+
+  size_t size() const { return threads.size(); }
+
+  // Usable cores: the smaller of the CPU affinity mask and the cgroup CPU
+  // quota (v1 or v2), and at least 1.
+  static size_t DefaultConcurrency();
+
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void Run(size_t self);
+  bool TryTake(size_t self, Task& task);
+  void Finish();
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+
+  std::mutex stateMutex;
+  std::condition_variable workAvailable;
+  std::condition_variable allDone;
+  size_t queued = 0;
+  size_t unfinished = 0;
+  bool stopping = false;
+
+  std::atomic<size_t> nextWorker{0};
+};
+
+// A set of tasks on a pool that can be waited for on its own. A waiting
+// thread runs queued pool tasks in the meantime, so a pool task may split
+// its work into a group and wait for it without deadlocking the pool.
+class TaskGroup {
+public:
+  explicit TaskGroup(WorkerPool& pool) : pool(pool) {}
+  ~TaskGroup() { Wait(); }
+
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  void Submit(WorkerPool::Task task);
+  void Wait();
+
+private:
+  WorkerPool& pool;
+  std::mutex mutex;
+  std::condition_variable done;
+  size_t pending = 0;
+};
+
+#endif // WORKER_POOL_H
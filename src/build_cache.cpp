@@ -0,0 +1,89 @@
+#include "build_cache.h"
+#include "content_hash.h"
+#include "input_file.h"
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace {
+
+// Hash of the file's bytes, which an entry records next to its size.
+bool HashOutput(const std::string& outputPath, std::string& hash) {
+    InputFile output;
+    std::string error;
+    if (!output.Open(outputPath, error)) {
+        return false;
+    }
+    hash = ToHex(Hash64(output.Data()));
+    return true;
+}
+
+} // namespace
+
+bool BuildCache::Open(std::string& error) {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        error = "Could not create cache directory " + directory + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+uint64_t BuildCache::Key(std::string_view input) const {
+    return Hash64(input, configHash);
+}
+
+std::string BuildCache::EntryPath(const std::string& outputPath) const {
+    std::string absolute = std::filesystem::absolute(outputPath).lexically_normal().string();
+    return (std::filesystem::path(directory) / (ToHex(Hash64(absolute)) + ".entry")).string();
+}
+
+bool BuildCache::IsFresh(const std::string& outputPath, uint64_t key) const {
+    std::ifstream entry(EntryPath(outputPath));
+    std::string recordedKey;
+    uintmax_t recordedSize = 0;
+    std::string recordedHash;
+    if (!(entry >> recordedKey >> recordedSize >> recordedHash) || recordedKey != ToHex(key)) {
+        return false;
+    }
+
+    // The size rules out most rewrites without reading the output.
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(outputPath, ec);
+    if (ec || size != recordedSize) {
+        return false;
+    }
+    std::string hash;
+    return HashOutput(outputPath, hash) && hash == recordedHash;
+}
+
+void BuildCache::Record(const std::string& outputPath, uint64_t key) const {
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(outputPath, ec);
+    std::string hash;
+    if (ec || !HashOutput(outputPath, hash)) {
+        return;
+    }
+
+    // Write to a private file and rename it, so readers never see half an entry.
+    std::string path = EntryPath(outputPath);
+    std::string temporary = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    {
+        std::ofstream entry(temporary, std::ios::trunc);
+        entry << ToHex(key) << " " << size << " " << hash << "\n";
+        if (!entry) {
+            std::filesystem::remove(temporary, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, path, ec);
+    if (ec) {
+        std::filesystem::remove(temporary, ec);
+    }
+}
+
+void BuildCache::Forget(const std::string& outputPath) const {
+    std::error_code ec;
+    std::filesystem::remove(EntryPath(outputPath), ec);
+}
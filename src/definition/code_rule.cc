@@ -1,26 +1,27 @@
 #include "code_rule.h"
+#include "rule_stats.h"
 
-bool CodeRule::Match(std::string_view input, size_t pos) {
-  if (pos >= input.size() || input[pos] != '`') {
-    return false;
-  }
+std::string_view CodeRule::FirstBytes() const {
+  return "`";
+}
 
-  if (input.empty()) {
-    return false;
-  }
-  
-  return IsCodeBlock(input, pos) || IsInlineCode(input, pos);
+RuleId CodeRule::Id() const {
+  return RuleId::Code;
 }
 
-Token CodeRule::Parse(std::string_view input, size_t& pos) {
+std::optional<Token> CodeRule::TryParse(std::string_view input, size_t& pos) const {
+  if (pos >= input.size() || input[pos] != '`') {
+    return std::nullopt;
+  }
+
   if (IsCodeBlock(input, pos)) {
     return ParseCodeBlock(input, pos);
-  } else {
-    return ParseInlineCode(input, pos);
   }
+
+  return ParseInlineCode(input, pos);
 }
 
-bool CodeRule::IsCodeBlock(std::string_view input, size_t pos) {
+bool CodeRule::IsCodeBlock(std::string_view input, size_t pos) const {
   if (!IsAtLineStart(input, pos)) {
     return false;
   }
@@ -28,32 +29,7 @@ bool CodeRule::IsCodeBlock(std::string_view input, size_t pos) {
   return CountBackticks(input, pos) >= 3;
 }
 
-bool CodeRule::IsInlineCode(std::string_view input, size_t pos) {
-  size_t backtickCount = CountBackticks(input, pos);
-  
-  if (backtickCount == 0 || backtickCount >= 3) {
-    return false;
-  }
-  
-  size_t searchPos = pos + backtickCount;
-  while (searchPos < input.size()) {
-    if (input[searchPos] == '`') {
-      size_t closingCount = CountBackticks(input, searchPos);
-      if (closingCount == backtickCount) {
-        return true;
-      }
-      searchPos += closingCount;
-    } else if (input[searchPos] == '\n') {
-      return false;
-    } else {
-      searchPos++;
-    }
-  }
-  
-  return false;
-}
-
-Token CodeRule::ParseCodeBlock(std::string_view input, size_t& pos) {
+Token CodeRule::ParseCodeBlock(std::string_view input, size_t& pos) const {
   size_t startPos = pos;
   size_t backtickCount = CountBackticks(input, pos);
   pos += backtickCount;
@@ -100,33 +76,39 @@ Token CodeRule::ParseCodeBlock(std::string_view input, size_t& pos) {
   return Token(Type::Code, codeContent, language, startPos, pos);
 }
 
-Token CodeRule::ParseInlineCode(std::string_view input, size_t& pos) {
-  size_t startPos = pos;
+// Looks for a closing run of the same length on the same line; the scan
+// that finds it also delimits the content.
+std::optional<Token> CodeRule::ParseInlineCode(std::string_view input, size_t& pos) const {
   size_t backtickCount = CountBackticks(input, pos);
-  pos += backtickCount;
   
-  size_t contentStart = pos;
+  if (backtickCount == 0 || backtickCount >= 3) {
+    return std::nullopt;
+  }
   
-  while (pos < input.size()) {
-    if (input[pos] == '`') {
-      size_t closingCount = CountBackticks(input, pos);
+  size_t contentStart = pos + backtickCount;
+  size_t searchPos = contentStart;
+  while (searchPos < input.size()) {
+    if (input[searchPos] == '`') {
+      size_t closingCount = CountBackticks(input, searchPos);
       if (closingCount == backtickCount) {
-        std::string_view codeContent = input.substr(contentStart, pos - contentStart);
-        pos += closingCount;
-        
-        return Token(Type::Code, codeContent, "", startPos, pos);
+        MARKDOWN_RULE_SCANNED(RuleId::Code, searchPos - pos);
+        size_t startPos = pos;
+        pos = searchPos + closingCount;
+        return Token(Type::Code, input.substr(contentStart, searchPos - contentStart), "", startPos, pos);
       }
-      pos += closingCount;
+      searchPos += closingCount;
+    } else if (input[searchPos] == '\n') {
+      break;
     } else {
-      pos++;
+      searchPos++;
     }
   }
   
-  std::string_view codeContent = input.substr(contentStart, pos - contentStart);
-  return Token(Type::Code, codeContent, "", startPos, pos);
+  MARKDOWN_RULE_SCANNED(RuleId::Code, searchPos - pos);
+  return std::nullopt;
 }
 
-size_t CodeRule::CountBackticks(std::string_view input, size_t pos) {
+size_t CodeRule::CountBackticks(std::string_view input, size_t pos) const {
   size_t count = 0;
   while (pos + count < input.size() && input[pos + count] == '`') {
     count++;
@@ -134,7 +116,7 @@ size_t CodeRule::CountBackticks(std::string_view input, size_t pos) {
   return count;
 }
 
-std::string_view CodeRule::ExtractLanguage(std::string_view input, size_t start, size_t& end) {
+std::string_view CodeRule::ExtractLanguage(std::string_view input, size_t start, size_t& end) const {
   end = start;
   
   while (end < input.size() && (input[end] == ' ' || input[end] == '\t')) {
@@ -158,7 +140,7 @@ std::string_view CodeRule::ExtractLanguage(std::string_view input, size_t start,
   return std::string_view();
 }
 
-std::string_view CodeRule::ExtractCodeContent(std::string_view input, size_t start, size_t end) {
+std::string_view CodeRule::ExtractCodeContent(std::string_view input, size_t start, size_t end) const {
   if (end <= start) {
     return std::string_view();
   }
@@ -166,7 +148,7 @@ std::string_view CodeRule::ExtractCodeContent(std::string_view input, size_t sta
   return input.substr(start, end - start);
 }
 
-bool CodeRule::IsAtLineStart(std::string_view input, size_t pos) {
+bool CodeRule::IsAtLineStart(std::string_view input, size_t pos) const {
   if (pos == 0) {
     return true;
   }
@@ -1,7 +1,16 @@
 #include "heading_rule.h"
+#include "rule_stats.h"
 #include <algorithm>
 
-bool HeadingRule::Match(std::string_view input, size_t pos) {
+std::string_view HeadingRule::FirstBytes() const {
+  return "#";
+}
+
+RuleId HeadingRule::Id() const {
+  return RuleId::Heading;
+}
+
+bool HeadingRule::Match(std::string_view input, size_t pos) const {
 
   if(input.empty()){
     return false;
@@ -29,7 +38,11 @@ bool HeadingRule::Match(std::string_view input, size_t pos) {
   return input[afterHashes] == ' ' || input[afterHashes] == '\n';
 }
 
-Token HeadingRule::Parse(std::string_view input, size_t& pos) {
+std::optional<Token> HeadingRule::TryParse(std::string_view input, size_t& pos) const {
+  if (!Match(input, pos)) {
+    return std::nullopt;
+  }
+
   size_t startPos = pos;
   
   size_t level = CountHashes(input, pos);
@@ -54,7 +67,7 @@ Token HeadingRule::Parse(std::string_view input, size_t& pos) {
   return Token(Type::Heading, headingText, levelStr, startPos, pos);
 }
 
-size_t HeadingRule::CountHashes(std::string_view input, size_t pos) {
+size_t HeadingRule::CountHashes(std::string_view input, size_t pos) const {
   size_t count = 0;
   while (pos + count < input.size() && input[pos + count] == '#' && count < 6) {
     count++;
@@ -62,12 +75,13 @@ size_t HeadingRule::CountHashes(std::string_view input, size_t pos) {
   return count;
 }
 
-std::string_view HeadingRule::ExtractHeadingText(std::string_view input, size_t start, size_t& end) {
+std::string_view HeadingRule::ExtractHeadingText(std::string_view input, size_t start, size_t& end) const {
   end = start;
   
   while (end < input.size() && input[end] != '\n') {
     end++;
   }
+  MARKDOWN_RULE_SCANNED(RuleId::Heading, end - start);
   
   size_t contentEnd = end;
   while (contentEnd > start && (input[contentEnd - 1] == ' ' || input[contentEnd - 1] == '#')) {
@@ -1,30 +1,37 @@
 #include "horizontalline_rule.h"
+#include "rule_stats.h"
 
-bool HorizontalRule::Match(std::string_view input, size_t pos) {
+std::string_view HorizontalRule::FirstBytes() const {
+    return "-*_";
+}
+
+RuleId HorizontalRule::Id() const {
+    return RuleId::HorizontalRule;
+}
+
+std::optional<Token> HorizontalRule::TryParse(std::string_view input, size_t& pos) const {
     if (!IsAtLineStart(input, pos)) {
-        return false;
+        return std::nullopt;
     }
     
     if (pos >= input.size()) {
-        return false;
+        return std::nullopt;
     }
     
     char c = input[pos];
     if (c != '-' && c != '*' && c != '_') {
-        return false;
+        return std::nullopt;
     }
     
-    return IsHorizontalRule(input, pos);
-}
-
-Token HorizontalRule::Parse(std::string_view input, size_t& pos) {
-    size_t startPos = pos;
-    
-    char c = input[pos];
-    while (pos < input.size() && (input[pos] == c || input[pos] == ' ' || input[pos] == '\t')) {
-        pos++;
+    // The check walks the whole line, so it already knows where it ends.
+    size_t end = pos;
+    if (!IsHorizontalRule(input, pos, end)) {
+        return std::nullopt;
     }
     
+    size_t startPos = pos;
+    pos = end;
+    
     if (pos < input.size() && input[pos] == '\n') {
         pos++;
     }
@@ -32,14 +39,14 @@ Token HorizontalRule::Parse(std::string_view input, size_t& pos) {
     return Token(Type::HorizontalRule, "", "", startPos, pos);
 }
 
-bool HorizontalRule::IsAtLineStart(std::string_view input, size_t pos) {
+bool HorizontalRule::IsAtLineStart(std::string_view input, size_t pos) const {
     if (pos == 0) {
         return true;
     }
     return input[pos - 1] == '\n';
 }
 
-bool HorizontalRule::IsHorizontalRule(std::string_view input, size_t pos) {
+bool HorizontalRule::IsHorizontalRule(std::string_view input, size_t pos, size_t& end) const {
     char c = input[pos];
     size_t count = 0;
     size_t tempPos = pos;
@@ -48,15 +55,18 @@ bool HorizontalRule::IsHorizontalRule(std::string_view input, size_t pos) {
         if (input[tempPos] == c) {
             count++;
         } else if (input[tempPos] != ' ' && input[tempPos] != '\t') {
+            MARKDOWN_RULE_SCANNED(RuleId::HorizontalRule, tempPos - pos);
             return false;
         }
         tempPos++;
     }
   
+    MARKDOWN_RULE_SCANNED(RuleId::HorizontalRule, tempPos - pos);
+    end = tempPos;
     return count >= 3;
 }
 
-size_t HorizontalRule::CountCharacter(std::string_view input, size_t pos, char c) {
+size_t HorizontalRule::CountCharacter(std::string_view input, size_t pos, char c) const {
     size_t count = 0;
     while (pos < input.size() && input[pos] == c) {
         count++;
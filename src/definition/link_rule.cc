@@ -1,96 +1,61 @@
 #include "link_rule.h"
+#include "rule_stats.h"
 
-bool LinkRule::Match(std::string_view input, size_t pos) {
+std::string_view LinkRule::FirstBytes() const {
+    return "[";
+}
+
+RuleId LinkRule::Id() const {
+    return RuleId::Link;
+}
+
+std::optional<Token> LinkRule::TryParse(std::string_view input, size_t& pos) const {
     if (input.empty() || pos >= input.size() || input[pos] != '[') {
-        return false;
+        return std::nullopt;
     }
 
     if (pos + 5 >= input.size()) {
-        return false;
+        return std::nullopt;
     }
 
     if (IsEscaped(input, pos)) {
-        return false;
-    }
-
-    return HasValidLinkStructure(input, pos);
-}
-
-Token LinkRule::Parse(std::string_view input, size_t& pos) {
-    size_t startPos = pos;
-
-    pos++;
-
-    size_t textEnd;
-    std::string_view linkText = ExtractLinkText(input, pos, textEnd);
-
-    pos = textEnd + 1;
-
-    if (pos >= input.size() || input[pos] != '(') {
-        pos = startPos + 1;
-        return Token(Type::Text, "[", "", startPos, pos);
+        return std::nullopt;
     }
 
-    pos++;
-
-    size_t urlEnd;
-    std::string_view linkUrl = ExtractLinkUrl(input, pos, urlEnd);
-
-    pos = urlEnd + 1;
-
-    return Token(Type::Link, linkText, linkUrl, startPos, pos);
-}
-
-bool LinkRule::HasValidLinkStructure(std::string_view input, size_t pos) {
     size_t closingBracket = FindClosingBracket(input, pos + 1);
-    if (closingBracket == std::string_view::npos) {
-        return false;
-    }
-
-    if (closingBracket == pos + 1) {
-        return false;
+    if (closingBracket == std::string_view::npos || closingBracket == pos + 1) {
+        return std::nullopt;
     }
 
     if (closingBracket + 1 >= input.size() || input[closingBracket + 1] != '(') {
-        return false;
+        return std::nullopt;
     }
 
-    size_t closingParen = FindClosingParen(input, closingBracket + 2);
+    bool plainUrl = true;
+    size_t closingParen = FindClosingParen(input, closingBracket + 2, plainUrl);
     if (closingParen == std::string_view::npos) {
-        return false;
+        return std::nullopt;
     }
 
-    return true;
-}
+    std::string_view linkText = input.substr(pos + 1, closingBracket - pos - 1);
 
-std::string_view LinkRule::ExtractLinkText(std::string_view input, size_t start, size_t& end) {
-    size_t pos = start;
-    int bracketDepth = 1;
-
-    while (pos < input.size() && bracketDepth > 0) {
-        if (IsEscaped(input, pos)) {
-            pos++;
-            continue;
-        }
-
-        if (input[pos] == '[') {
-            bracketDepth++;
-        } else if (input[pos] == ']') {
-            bracketDepth--;
-            if (bracketDepth == 0) {
-                end = pos;
-                return input.substr(start, pos - start);
-            }
-        }
-
-        pos++;
+    // A destination without spaces, angle brackets or escapes is exactly the
+    // span the paren scan just found; only the others need a second look.
+    size_t urlEnd = closingParen;
+    std::string_view linkUrl;
+    if (plainUrl) {
+        linkUrl = input.substr(closingBracket + 2, closingParen - closingBracket - 2);
+    } else {
+        linkUrl = ExtractLinkUrl(input, closingBracket + 2, urlEnd);
     }
 
-    end = pos;
-    return std::string_view();
+    size_t startPos = pos;
+    pos = urlEnd + 1;
+
+    return Token(Type::Link, linkText, linkUrl, startPos, pos);
 }
 
-std::string_view LinkRule::ExtractLinkUrl(std::string_view input, size_t start, size_t& end) {
+std::string_view LinkRule::ExtractLinkUrl(std::string_view input, size_t start, size_t& end) const {
     size_t pos = start;
 
     while (pos < input.size() && (input[pos] == ' ' || input[pos] == '\t')) {
@@ -173,7 +138,7 @@ std::string_view LinkRule::ExtractLinkUrl(std::string_view input, size_t start,
     return std::string_view();
 }
 
-size_t LinkRule::FindClosingBracket(std::string_view input, size_t start) {
+size_t LinkRule::FindClosingBracket(std::string_view input, size_t start) const {
     size_t pos = start;
     int depth = 1;
 
@@ -188,6 +153,7 @@ size_t LinkRule::FindClosingBracket(std::string_view input, size_t start) {
         } else if (input[pos] == ']') {
             depth--;
             if (depth == 0) {
+                MARKDOWN_RULE_SCANNED(RuleId::Link, pos - start);
                 return pos;
             }
         }
@@ -195,15 +161,20 @@ size_t LinkRule::FindClosingBracket(std::string_view input, size_t start) {
         pos++;
     }
 
+    MARKDOWN_RULE_SCANNED(RuleId::Link, pos - start);
     return std::string_view::npos;
 }
 
-size_t LinkRule::FindClosingParen(std::string_view input, size_t start) {
+size_t LinkRule::FindClosingParen(std::string_view input, size_t start, bool& plain) const {
     size_t pos = start;
     int depth = 1;
     bool inAngleBrackets = false;
 
     while (pos < input.size()) {
+        if (input[pos] == '\\' || input[pos] == '<' || input[pos] == ' ' || input[pos] == '\t') {
+            plain = false;
+        }
+
         if (input[pos] == '\\' && pos + 1 < input.size()) {
             pos += 2;
             continue;
@@ -218,6 +189,7 @@ size_t LinkRule::FindClosingParen(std::string_view input, size_t start) {
         } else if (!inAngleBrackets && input[pos] == ')') {
             depth--;
             if (depth == 0) {
+                MARKDOWN_RULE_SCANNED(RuleId::Link, pos - start);
                 return pos;
             }
         }
@@ -225,10 +197,11 @@ size_t LinkRule::FindClosingParen(std::string_view input, size_t start) {
         pos++;
     }
 
+    MARKDOWN_RULE_SCANNED(RuleId::Link, pos - start);
     return std::string_view::npos;
 }
 
-bool LinkRule::IsEscaped(std::string_view input, size_t pos) {
+bool LinkRule::IsEscaped(std::string_view input, size_t pos) const {
     if (pos == 0) {
         return false;
     }
@@ -1,6 +1,15 @@
 #include "list_rule.h"
+#include "rule_stats.h"
 
-bool ListRule::Match(std::string_view input, size_t pos) {
+std::string_view ListRule::FirstBytes() const {
+  return " \t-*+0123456789";
+}
+
+RuleId ListRule::Id() const {
+  return RuleId::List;
+}
+
+bool ListRule::Match(std::string_view input, size_t pos) const {
   if (pos >= input.size()) {
     return false;
   }
@@ -23,7 +32,11 @@ bool ListRule::Match(std::string_view input, size_t pos) {
   return IsUnorderedList(input, pos) || IsOrderedList(input, pos);
 }
 
-Token ListRule::Parse(std::string_view input, size_t& pos) {
+std::optional<Token> ListRule::TryParse(std::string_view input, size_t& pos) const {
+  if (!Match(input, pos)) {
+    return std::nullopt;
+  }
+
   size_t startPos = pos;
   
   size_t spaceCount = CountLeadingSpaces(input, pos);
@@ -48,7 +61,7 @@ Token ListRule::Parse(std::string_view input, size_t& pos) {
   return Token(Type::listItem, content, marker, startPos, pos);
 }
 
-bool ListRule::IsUnorderedList(std::string_view input, size_t pos) {
+bool ListRule::IsUnorderedList(std::string_view input, size_t pos) const {
   if (pos >= input.size()) {
     return false;
   }
@@ -65,7 +78,7 @@ bool ListRule::IsUnorderedList(std::string_view input, size_t pos) {
   return input[pos + 1] == ' ' || input[pos + 1] == '\t' || input[pos + 1] == '\n';
 }
 
-bool ListRule::IsOrderedList(std::string_view input, size_t pos) {
+bool ListRule::IsOrderedList(std::string_view input, size_t pos) const {
   if (pos >= input.size() || !IsDigit(input[pos])) {
     return false;
   }
@@ -86,12 +99,13 @@ bool ListRule::IsOrderedList(std::string_view input, size_t pos) {
   return input[digitPos + 1] == ' ' || input[digitPos + 1] == '\t' || input[digitPos + 1] == '\n';
 }
 
-std::string_view ListRule::ExtractListContent(std::string_view input, size_t start, size_t& end) {
+std::string_view ListRule::ExtractListContent(std::string_view input, size_t start, size_t& end) const {
   end = start;
   
   while (end < input.size() && input[end] != '\n') {
     end++;
   }
+  MARKDOWN_RULE_SCANNED(RuleId::List, end - start);
   
   size_t contentEnd = end;
   while (contentEnd > start && (input[contentEnd - 1] == ' ' || input[contentEnd - 1] == '\t')) {
@@ -105,7 +119,7 @@ std::string_view ListRule::ExtractListContent(std::string_view input, size_t sta
   return input.substr(start, contentEnd - start);
 }
 
-std::string_view ListRule::ExtractListMarker(std::string_view input, size_t pos, size_t& markerEnd) {
+std::string_view ListRule::ExtractListMarker(std::string_view input, size_t pos, size_t& markerEnd) const {
   size_t start = pos;
   
   if (pos < input.size() && (input[pos] == '-' || input[pos] == '*' || input[pos] == '+')) {
@@ -129,7 +143,7 @@ std::string_view ListRule::ExtractListMarker(std::string_view input, size_t pos,
   return std::string_view();
 }
 
-bool ListRule::IsAtLineStart(std::string_view input, size_t pos) {
+bool ListRule::IsAtLineStart(std::string_view input, size_t pos) const {
   if (pos == 0) {
     return true;
   }
@@ -137,11 +151,11 @@ bool ListRule::IsAtLineStart(std::string_view input, size_t pos) {
   return input[pos - 1] == '\n';
 }
 
-bool ListRule::IsDigit(char c) {
+bool ListRule::IsDigit(char c) const {
   return c >= '0' && c <= '9';
 }
 
-size_t ListRule::CountLeadingSpaces(std::string_view input, size_t pos) {
+size_t ListRule::CountLeadingSpaces(std::string_view input, size_t pos) const {
   size_t count = 0;
   while (pos + count < input.size() && 
          (input[pos + count] == ' ' || input[pos + count] == '\t')) {
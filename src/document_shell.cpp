@@ -0,0 +1,118 @@
+#include "document_shell.h"
+#include "html_escape.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static bool ReadText(const std::string& path, std::string& text) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    text = buffer.str();
+    return true;
+}
+
+const char* DocumentShell::DefaultTemplate() {
+    return "<!DOCTYPE html>\n"
+           "<html>\n<head>\n"
+           "<meta charset=\"UTF-8\">\n"
+           "<title>Markdown Output</title>\n"
+           "{{head}}"
+           "</head>\n<body>\n"
+           "{{body}}"
+           "</body>\n</html>\n";
+}
+
+bool DocumentShell::Load(ShellMode shellMode, const std::string& stylesheet, const std::string& templatePath, std::string& error) {
+    mode = shellMode;
+    prefix.clear();
+    suffix.clear();
+
+    if (mode == ShellMode::Fragment) {
+        return true;
+    }
+
+    std::string text = DefaultTemplate();
+    if (!templatePath.empty() && !ReadText(templatePath, text)) {
+        error = "Could not read template: " + templatePath;
+        return false;
+    }
+
+    size_t body = text.find("{{body}}");
+    if (body == std::string::npos) {
+        error = "Template has no {{body}} placeholder: " + templatePath;
+        return false;
+    }
+
+    std::string head;
+    if (mode == ShellMode::InlineStyle) {
+        std::string css;
+        if (!ReadText(stylesheet, css)) {
+            css = "/* Could not load CSS file */";
+        }
+        head = "<style>\n" + css + "\n</style>\n";
+    } else {
+        head = "<link rel=\"stylesheet\" href=\"";
+        EscapeHTML(stylesheet, head);
+        head += "\">\n";
+    }
+
+    prefix = text.substr(0, body);
+    suffix = text.substr(body + 8);
+
+    size_t slot = prefix.find("{{head}}");
+    if (slot != std::string::npos) {
+        prefix.replace(slot, 8, head);
+    }
+
+    return true;
+}
+
+bool DocumentShell::Write(int fd, std::string_view body) const {
+    iovec parts[3] = {
+        {const_cast<char*>(prefix.data()), prefix.size()},
+        {const_cast<char*>(body.data()), body.size()},
+        {const_cast<char*>(suffix.data()), suffix.size()},
+    };
+    iovec* next = parts;
+    int count = 3;
+
+    while (count > 0) {
+        ssize_t written = ::writev(fd, next, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        size_t remaining = static_cast<size_t>(written);
+        while (count > 0 && remaining >= next->iov_len) {
+            remaining -= next->iov_len;
+            ++next;
+            --count;
+        }
+        if (count > 0) {
+            next->iov_base = static_cast<char*>(next->iov_base) + remaining;
+            next->iov_len -= remaining;
+        }
+    }
+
+    return true;
+}
+
+bool DocumentShell::WriteFile(const std::string& path, std::string_view body) const {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool ok = Write(fd, body);
+    return ::close(fd) == 0 && ok;
+}
@@ -0,0 +1,457 @@
+#include "file_pipeline.h"
+#include "renderer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+
+constexpr unsigned kRingEntries = 256;
+constexpr unsigned kRingFileSlots = 64;
+// Files up to this size are read through the ring into memory; larger ones
+// are mapped, which saves the copy.
+constexpr uint64_t kRingReadMax = 1 << 20;
+// Bodies larger than this are written with writev.
+constexpr size_t kRingWriteMax = 1u << 30;
+// Ring operations per file: open, read or up to three writes, close.
+constexpr unsigned kReadSteps = 3;
+constexpr unsigned kWriteSteps = 5;
+
+// Open failures that are about the file itself, which the plain path would
+// hit too. Anything else is the ring's doing, e.g. EINVAL from a kernel that
+// cannot open into a slot.
+bool IsFileError(int error) {
+    switch (error) {
+    case ENOENT:
+    case EACCES:
+    case EPERM:
+    case ENOTDIR:
+    case EISDIR:
+    case ELOOP:
+    case ENAMETOOLONG:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Splits a batch's time evenly over its files.
+StageTime Share(StageTime time, size_t files) {
+    time.wallNs /= files;
+    time.cpuNs /= files;
+    return time;
+}
+
+} // namespace
+
+FilePipeline::FilePipeline(const DocumentShell& shell, WorkerPool& pool, RenderStage render, Limits limits,
+                           bool timeStages)
+    : shell(shell), pool(pool), render(std::move(render)), limits(limits), timeStages(timeStages) {
+    if (this->limits.maxFiles == 0) {
+        this->limits.maxFiles = pool.size() * 4;
+    }
+
+    std::string error;
+    if (limits.ioRing && readRing.Open(kRingEntries, kRingFileSlots, error) &&
+        writeRing.Open(kRingEntries, kRingFileSlots, error)) {
+        usesIoRing = true;
+        // Every output starts and ends with the same bytes; pinning them once
+        // spares the kernel mapping them again for each file.
+        iovec buffers[2];
+        unsigned count = 0;
+        if (!shell.Prefix().empty()) {
+            buffers[count] = {const_cast<char*>(shell.Prefix().data()), shell.Prefix().size()};
+            prefixBuffer = static_cast<int>(count++);
+        }
+        if (!shell.Suffix().empty()) {
+            buffers[count] = {const_cast<char*>(shell.Suffix().data()), shell.Suffix().size()};
+            suffixBuffer = static_cast<int>(count++);
+        }
+        if (count > 0 && !writeRing.RegisterBuffers(buffers, count, error)) {
+            prefixBuffer = suffixBuffer = -1;
+        }
+    }
+
+    reader = std::thread([this] { ReadLoop(); });
+    writer = std::thread([this] { WriteLoop(); });
+}
+
+FilePipeline::~FilePipeline() {
+    Finish();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    stopping = true;
+    readable.notify_all();
+    writable.notify_all();
+    lock.unlock();
+
+    reader.join();
+    writer.join();
+}
+
+void FilePipeline::Add(std::unique_ptr<FileJob> job) {
+    std::lock_guard<std::mutex> lock(mutex);
+    added.push_back(std::move(job));
+    ++unfinished;
+    readable.notify_one();
+}
+
+void FilePipeline::Finish() {
+    std::unique_lock<std::mutex> lock(mutex);
+    drained.wait(lock, [this] { return unfinished == 0; });
+}
+
+void FilePipeline::Prefetch(Pending& pending) {
+    pending.fd = ::open(pending.job->input.c_str(), O_RDONLY | O_CLOEXEC);
+    if (pending.fd < 0) {
+        pending.job->error = "Could not open file: " + pending.job->input + " (" + std::strerror(errno) + ")";
+        return;
+    }
+
+    struct stat info;
+    if (fstat(pending.fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        pending.size = static_cast<uint64_t>(info.st_size);
+        pending.regular = true;
+        posix_fadvise(pending.fd, 0, 0, POSIX_FADV_WILLNEED);
+    }
+}
+
+void FilePipeline::Prefetch(std::deque<Pending>& window, size_t from) {
+    std::vector<struct statx> info(window.size() - from);
+    std::vector<IoRing::Completion> completions;
+    std::string error;
+    size_t queued = from;
+    while (readRing.IsOpen() && queued < window.size() &&
+           readRing.Statx(window[queued].job->input.c_str(), &info[queued - from], queued)) {
+        ++queued;
+    }
+    // Whatever was queued runs now: the entries point into `info`.
+    if (queued > from && !readRing.Run(completions, error)) {
+        completions.clear();
+        queued = from;
+    }
+
+    // Files the ring did not stat, or every file without a ring: open each
+    // now so the kernel starts reading it.
+    for (size_t i = queued; i < window.size(); ++i) {
+        Prefetch(window[i]);
+    }
+
+    for (const IoRing::Completion& completion : completions) {
+        Pending& pending = window[completion.tag];
+        if (completion.result < 0) {
+            pending.job->error =
+                "Could not open file: " + pending.job->input + " (" + std::strerror(-completion.result) + ")";
+            continue;
+        }
+        const struct statx& stat = info[completion.tag - from];
+        pending.regular = S_ISREG(stat.stx_mode);
+        pending.size = pending.regular ? stat.stx_size : 0;
+        // Larger files are mapped rather than read through the ring; have
+        // the kernel start on them now all the same.
+        if (pending.regular && pending.size >= kRingReadMax) {
+            Prefetch(pending);
+        }
+    }
+}
+
+size_t FilePipeline::Admit(std::deque<Pending>& window) {
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t count = 0;
+    for (Pending& pending : window) {
+        pending.charge = pending.size + Renderer::EstimateSize(pending.size);
+        auto fits = [&] {
+            return filesInFlight < limits.maxFiles && bytesInFlight + pending.charge <= limits.maxBytes;
+        };
+        if (count == 0) {
+            // A single larger file still goes through, on its own.
+            readable.wait(lock, [&] { return filesInFlight == 0 || fits(); });
+        } else if (!fits()) {
+            break;
+        }
+        bytesInFlight += pending.charge;
+        ++filesInFlight;
+        ++count;
+    }
+    return count;
+}
+
+void FilePipeline::Read(std::deque<Pending>& window, size_t count) {
+    std::vector<size_t> ringFiles;
+    for (size_t i = 0; i < count; ++i) {
+        Pending& pending = window[i];
+        FileJob& job = *pending.job;
+        if (timeStages) {
+            job.started.emplace();
+        }
+        if (!job.error.empty()) {
+            continue;
+        }
+
+        if (readRing.IsOpen() && pending.fd < 0 && pending.regular && pending.size < kRingReadMax &&
+            ringFiles.size() < readRing.FileSlots()) {
+            ringFiles.push_back(i);
+            continue;
+        }
+
+        StageClock clock;
+        if (pending.fd >= 0) {
+            job.readOk = job.file.Open(pending.fd, job.input, job.error, true);
+            ::close(pending.fd);
+            pending.fd = -1;
+        } else {
+            job.readOk = job.file.Open(job.input, job.error, true);
+        }
+        if (timeStages) {
+            job.metrics[Stage::Read] = clock.Elapsed();
+        }
+    }
+
+    if (!ringFiles.empty()) {
+        ReadThroughRing(window, ringFiles);
+    }
+}
+
+void FilePipeline::ReadThroughRing(std::deque<Pending>& window, const std::vector<size_t>& files) {
+    StageClock clock;
+    // One spare byte shows whether the file grew since it was stat'ed.
+    std::vector<std::string> buffers(files.size());
+    for (size_t k = 0; k < files.size(); ++k) {
+        Pending& pending = window[files[k]];
+        buffers[k].resize(pending.size + 1);
+        uint64_t tag = k * kReadSteps;
+        readRing.OpenAt(pending.job->input.c_str(), O_RDONLY, 0, static_cast<unsigned>(k), tag, true);
+        readRing.Read(static_cast<unsigned>(k), buffers[k].data(), static_cast<uint32_t>(buffers[k].size()), 0,
+                      tag + 1, true);
+        readRing.Close(static_cast<unsigned>(k), tag + 2);
+    }
+
+    std::vector<IoRing::Completion> completions;
+    std::string error;
+    bool ran = readRing.Run(completions, error);
+    std::vector<int32_t> opened(files.size(), -ECANCELED);
+    std::vector<int32_t> read(files.size(), -ECANCELED);
+    for (const IoRing::Completion& completion : completions) {
+        size_t k = completion.tag / kReadSteps;
+        switch (completion.tag % kReadSteps) {
+        case 0:
+            opened[k] = completion.result;
+            break;
+        case 1:
+            read[k] = completion.result;
+            break;
+        }
+    }
+
+    StageTime share = Share(clock.Elapsed(), files.size());
+    for (size_t k = 0; k < files.size(); ++k) {
+        FileJob& job = *window[files[k]].job;
+        if (ran && opened[k] < 0 && IsFileError(-opened[k])) {
+            job.error = "Could not open file: " + job.input + " (" + std::strerror(-opened[k]) + ")";
+        } else if (ran && read[k] >= 0 && static_cast<size_t>(read[k]) < buffers[k].size()) {
+            buffers[k].resize(static_cast<size_t>(read[k]));
+            job.file.Assign(std::move(buffers[k]));
+            job.readOk = true;
+        } else {
+            // The file grew, or the ring failed it: take the plain path.
+            job.readOk = job.file.Open(job.input, job.error, true);
+        }
+        if (timeStages) {
+            job.metrics[Stage::Read] = share;
+        }
+    }
+}
+
+void FilePipeline::ReadLoop() {
+    // The files being read plus up to readAhead files the kernel is already
+    // fetching, all opened in the order they were added.
+    std::deque<Pending> window;
+
+    while (true) {
+        size_t fresh = window.size();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (window.empty()) {
+                readable.wait(lock, [this] { return !added.empty() || stopping; });
+            }
+            while (window.size() <= limits.readAhead && !added.empty()) {
+                window.push_back({std::move(added.front())});
+                added.pop_front();
+            }
+        }
+        if (window.empty()) {
+            return;
+        }
+        if (fresh < window.size()) {
+            Prefetch(window, fresh);
+        }
+
+        // Backpressure: wait until files fit next to those in flight.
+        size_t count = Admit(window);
+        Read(window, count);
+
+        for (size_t i = 0; i < count; ++i) {
+            std::unique_ptr<FileJob> job = std::move(window.front().job);
+            uint64_t charge = window.front().charge;
+            window.pop_front();
+
+            if (!job->readOk) {
+                Enqueue(std::move(job), charge);
+                continue;
+            }
+
+            FileJob* raw = job.release();
+            pool.Submit([this, raw, charge] {
+                std::unique_ptr<FileJob> rendered(raw);
+                render(*rendered);
+                Enqueue(std::move(rendered), charge);
+            });
+        }
+    }
+}
+
+void FilePipeline::Enqueue(std::unique_ptr<FileJob> job, uint64_t charge) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ready.emplace_back(std::move(job), charge);
+    // The writer only sleeps on an empty queue.
+    if (ready.size() == 1) {
+        writable.notify_one();
+    }
+}
+
+void FilePipeline::Write(std::deque<std::pair<std::unique_ptr<FileJob>, uint64_t>>& batch) {
+    std::vector<FileJob*> ringJobs;
+    for (auto& entry : batch) {
+        FileJob& job = *entry.first;
+        if (!job.write) {
+            continue;
+        }
+        if (writeRing.IsOpen() && job.html.size() <= kRingWriteMax) {
+            ringJobs.push_back(&job);
+            continue;
+        }
+
+        StageClock clock;
+        job.written = shell.WriteFile(job.output, job.html);
+        if (timeStages) {
+            job.metrics[Stage::Write] = clock.Elapsed();
+        }
+    }
+
+    size_t chunk = std::min<size_t>(writeRing.FileSlots(), writeRing.Capacity() / kWriteSteps);
+    for (size_t begin = 0; begin < ringJobs.size(); begin += chunk) {
+        size_t end = std::min(ringJobs.size(), begin + chunk);
+        WriteThroughRing(std::vector<FileJob*>(ringJobs.begin() + begin, ringJobs.begin() + end));
+    }
+}
+
+void FilePipeline::WriteThroughRing(const std::vector<FileJob*>& jobs) {
+    StageClock clock;
+    std::string_view prefix = shell.Prefix();
+    std::string_view suffix = shell.Suffix();
+    for (size_t k = 0; k < jobs.size(); ++k) {
+        const FileJob& job = *jobs[k];
+        unsigned slot = static_cast<unsigned>(k);
+        uint64_t tag = k * kWriteSteps;
+        writeRing.OpenAt(job.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644, slot, tag, true);
+        uint64_t offset = 0;
+        if (!prefix.empty()) {
+            writeRing.Write(slot, prefix.data(), static_cast<uint32_t>(prefix.size()), offset, tag + 1, true,
+                            prefixBuffer);
+            offset += prefix.size();
+        }
+        if (!job.html.empty()) {
+            writeRing.Write(slot, job.html.data(), static_cast<uint32_t>(job.html.size()), offset, tag + 2, true);
+            offset += job.html.size();
+        }
+        if (!suffix.empty()) {
+            writeRing.Write(slot, suffix.data(), static_cast<uint32_t>(suffix.size()), offset, tag + 3, true,
+                            suffixBuffer);
+        }
+        writeRing.Close(slot, tag + 4);
+    }
+
+    std::vector<IoRing::Completion> completions;
+    std::string error;
+    bool ran = writeRing.Run(completions, error);
+    std::vector<bool> failed(jobs.size(), !ran);
+    for (const IoRing::Completion& completion : completions) {
+        size_t k = completion.tag / kWriteSteps;
+        size_t expected = 0;
+        switch (completion.tag % kWriteSteps) {
+        case 1:
+            expected = prefix.size();
+            break;
+        case 2:
+            expected = jobs[k]->html.size();
+            break;
+        case 3:
+            expected = suffix.size();
+            break;
+        }
+        if (completion.result < 0 || static_cast<size_t>(completion.result) != expected) {
+            failed[k] = true;
+        }
+    }
+
+    StageTime share = Share(clock.Elapsed(), jobs.size());
+    for (size_t k = 0; k < jobs.size(); ++k) {
+        FileJob& job = *jobs[k];
+        StageClock retry;
+        // A short or failed write is redone from scratch the plain way.
+        job.written = !failed[k] || shell.WriteFile(job.output, job.html);
+        if (timeStages) {
+            job.metrics[Stage::Write] = share;
+            if (failed[k]) {
+                job.metrics[Stage::Write] += retry.Elapsed();
+            }
+        }
+    }
+}
+
+void FilePipeline::WriteLoop() {
+    std::deque<std::pair<std::unique_ptr<FileJob>, uint64_t>> batch;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            writable.wait(lock, [this] { return !ready.empty() || stopping; });
+            if (ready.empty()) {
+                return;
+            }
+            // Everything rendered since the last round is written in one go.
+            batch.swap(ready);
+        }
+
+        Write(batch);
+
+        for (auto& [job, charge] : batch) {
+            if (job->started) {
+                // Stages ran on different threads, so only their CPU times add up.
+                job->metrics.total = job->started->Elapsed();
+                job->metrics.total.cpuNs = 0;
+                for (const StageTime& stage : job->metrics.stages) {
+                    job->metrics.total.cpuNs += stage.cpuNs;
+                }
+            }
+            if (job->done) {
+                job->done(*job);
+            }
+            // Unmaps the input and frees the body before the budget is returned.
+            job.reset();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            bytesInFlight -= charge;
+            --filesInFlight;
+            readable.notify_one();
+            if (--unfinished == 0) {
+                drained.notify_all();
+            }
+        }
+        batch.clear();
+    }
+}
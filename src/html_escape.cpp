@@ -0,0 +1,132 @@
+#include "html_escape.h"
+#include "cpu_features.h"
+
+#ifdef MARKDOWN_X86
+#include <immintrin.h>
+#endif
+
+static std::string_view EntityFor(char c) {
+    switch (c)
+    {
+    case '<':
+        return "&lt;";
+    case '>':
+        return "&gt;";
+    case '&':
+        return "&amp;";
+    case '"':
+        return "&quot;";
+    case '\'':
+        return "&#39;";
+    default:
+        return {};
+    }
+}
+
+static size_t FindEscapableScalar(const char* data, size_t pos, size_t size) {
+    for (; pos < size; ++pos) {
+        char c = data[pos];
+        if (c == '<' || c == '>' || c == '&' || c == '"' || c == '\'') {
+            return pos;
+        }
+    }
+    return size;
+}
+
+#ifdef MARKDOWN_X86
+
+__attribute__((target("sse2")))
+static size_t FindEscapableSSE2(const char* data, size_t pos, size_t size) {
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i gt = _mm_set1_epi8('>');
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i quot = _mm_set1_epi8('"');
+    const __m128i apos = _mm_set1_epi8('\'');
+
+    for (; pos + 16 <= size; pos += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, lt), _mm_cmpeq_epi8(chunk, gt)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, amp), _mm_cmpeq_epi8(chunk, quot)),
+                         _mm_cmpeq_epi8(chunk, apos)));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0) {
+            return pos + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+        }
+    }
+    return FindEscapableScalar(data, pos, size);
+}
+
+__attribute__((target("avx2")))
+static size_t FindEscapableAVX2(const char* data, size_t pos, size_t size) {
+    const __m256i lt = _mm256_set1_epi8('<');
+    const __m256i gt = _mm256_set1_epi8('>');
+    const __m256i amp = _mm256_set1_epi8('&');
+    const __m256i quot = _mm256_set1_epi8('"');
+    const __m256i apos = _mm256_set1_epi8('\'');
+
+    for (; pos + 32 <= size; pos += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i hits = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, lt), _mm256_cmpeq_epi8(chunk, gt)),
+            _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, amp), _mm256_cmpeq_epi8(chunk, quot)),
+                            _mm256_cmpeq_epi8(chunk, apos)));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hits));
+        if (mask != 0) {
+            return pos + static_cast<size_t>(__builtin_ctz(mask));
+        }
+    }
+    return FindEscapableSSE2(data, pos, size);
+}
+
+#endif // MARKDOWN_X86
+
+using FindKernel = size_t (*)(const char* data, size_t pos, size_t size);
+
+static FindKernel SelectedKernel() {
+    static const FindKernel kernel = []() -> FindKernel {
+#ifdef MARKDOWN_X86
+        if (CpuHasAVX2()) {
+            return FindEscapableAVX2;
+        }
+        if (CpuHasSSE2()) {
+            return FindEscapableSSE2;
+        }
+#endif
+        return FindEscapableScalar;
+    }();
+    return kernel;
+}
+
+size_t FindEscapable(std::string_view text, size_t from) {
+    return SelectedKernel()(text.data(), from, text.size());
+}
+
+void EscapeHTML(std::string_view text, OutputSink& out) {
+    FindKernel find = SelectedKernel();
+    size_t cleanStart = 0;
+    size_t pos = find(text.data(), 0, text.size());
+
+    while (pos < text.size()) {
+        out << text.substr(cleanStart, pos - cleanStart) << EntityFor(text[pos]);
+        cleanStart = pos + 1;
+        pos = find(text.data(), cleanStart, text.size());
+    }
+
+    out << text.substr(cleanStart);
+}
+
+void EscapeHTML(std::string_view text, std::string& out) {
+    FindKernel find = SelectedKernel();
+    size_t cleanStart = 0;
+    size_t pos = find(text.data(), 0, text.size());
+
+    while (pos < text.size()) {
+        out.append(text, cleanStart, pos - cleanStart);
+        out.append(EntityFor(text[pos]));
+        cleanStart = pos + 1;
+        pos = find(text.data(), cleanStart, text.size());
+    }
+
+    out.append(text, cleanStart);
+}
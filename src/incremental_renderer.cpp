@@ -0,0 +1,90 @@
+#include "incremental_renderer.h"
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+void IncrementalRenderer::Load(std::string text) {
+    source = std::move(text);
+    doc = lexer.Tokenize(source);
+
+    blocks.clear();
+    for (uint32_t i = 0; i < doc.size(); i = doc[i].next) {
+        blocks.push_back(Block{i, ParseState(), std::string()});
+    }
+    RenderFrom(0, blocks.size());
+}
+
+size_t IncrementalRenderer::Apply(size_t offset, size_t removed, std::string_view text) {
+    if (offset > source.size()) {
+        throw std::out_of_range("edit offset past end of source");
+    }
+    removed = std::min(removed, source.size() - offset);
+
+    source.replace(offset, removed, text.data(), text.size());
+    BlockRange range = lexer.Retokenize(doc, source, Edit{offset, removed, text.size()});
+
+    // Swap the blocks of the rewritten range for the new ones and renumber
+    // the nodes after it.
+    auto first = std::lower_bound(blocks.begin(), blocks.end(), range.first,
+                                  [](const Block& block, uint32_t node) { return block.node < node; });
+    auto last = std::lower_bound(first, blocks.end(), range.oldEnd,
+                                 [](const Block& block, uint32_t node) { return block.node < node; });
+    size_t from = static_cast<size_t>(first - blocks.begin());
+    ParseState before = first != blocks.end() ? first->before : ParseState();
+
+    int64_t indexShift = static_cast<int64_t>(range.newEnd) - static_cast<int64_t>(range.oldEnd);
+    for (auto block = last; block != blocks.end(); ++block) {
+        block->node = static_cast<uint32_t>(block->node + indexShift);
+    }
+
+    std::vector<Block> replaced;
+    for (uint32_t i = range.first; i < range.newEnd; i = doc[i].next) {
+        replaced.push_back(Block{i, ParseState(), std::string()});
+    }
+    blocks.erase(first, last);
+    blocks.insert(blocks.begin() + from, replaced.begin(), replaced.end());
+
+    if (from < blocks.size()) {
+        blocks[from].before = before;
+    }
+    return RenderFrom(from, from + replaced.size());
+}
+
+size_t IncrementalRenderer::RenderFrom(size_t from, size_t through) {
+    ParseState state = from < blocks.size() ? blocks[from].before : ParseState();
+
+    size_t rendered = 0;
+    for (size_t i = from; i < blocks.size(); ++i) {
+        Block& block = blocks[i];
+        if (i >= through && state == block.before) {
+            break;
+        }
+
+        block.before = state;
+        BufferSink html;
+        parser.ParseBlock(doc, block.node, html, state);
+        block.html = html.Take();
+        ++rendered;
+    }
+    return rendered;
+}
+
+void IncrementalRenderer::Write(OutputSink& out) const {
+    for (const Block& block : blocks) {
+        out.Write(block.html);
+    }
+}
+
+std::string IncrementalRenderer::Html() const {
+    size_t size = 0;
+    for (const Block& block : blocks) {
+        size += block.html.size();
+    }
+
+    std::string html;
+    html.reserve(size);
+    for (const Block& block : blocks) {
+        html += block.html;
+    }
+    return html;
+}
@@ -0,0 +1,316 @@
+#include "inline_lexer.h"
+#include "code_rule.h"
+#include "link_rule.h"
+#include "horizontalline_rule.h"
+#include "rule_pipeline.h"
+#include <algorithm>
+
+// Inline rules, in priority order: the first matching rule wins. Emphasis
+// is not a rule; '*' and '_' runs that no rule takes are delimiters.
+using InlineRules = MakePipeline<RuleIf<MARKDOWN_RULE_CODE, CodeRule>,
+                                 RuleIf<MARKDOWN_RULE_LINK, LinkRule>,
+                                 RuleIf<MARKDOWN_RULE_HR, HorizontalRule>>::type;
+
+static_assert((InlineRules::kAll & InlineLexer::kDelimiter) == 0, "rule bits overlap the delimiter bit");
+
+namespace {
+
+// A code span, link or rule token, or a run of '*' or '_' delimiters.
+struct InlineItem {
+    size_t start;
+    size_t end;
+    Token token;
+    // Index into InlineScratch::runs, or -1 for a token.
+    int32_t run;
+};
+
+struct DelimiterRun {
+    size_t start;
+    size_t length;
+    char marker;
+    bool canOpen;
+    bool canClose;
+    // Delimiters used by closers, taken from the start of the run, and by
+    // openers, taken from its end.
+    size_t closeUsed = 0;
+    size_t openUsed = 0;
+    // Matches this run closes, first to last, and opens, outermost first.
+    int32_t firstClose = -1;
+    int32_t lastClose = -1;
+    int32_t firstOpen = -1;
+};
+
+// One <em> (length 1) or <strong> (length 2) between an opener and closer.
+struct EmphasisMatch {
+    size_t openPos;
+    size_t closePos;
+    size_t length;
+    uint32_t node = 0;
+    int32_t nextClose = -1;
+    int32_t nextOpen = -1;
+};
+
+// Reused between calls so lexing a block allocates nothing once warmed up.
+struct InlineScratch {
+    std::vector<InlineItem> items;
+    std::vector<DelimiterRun> runs;
+    std::vector<EmphasisMatch> matches;
+    std::vector<uint32_t> openers;
+};
+
+bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+bool IsPunctuation(char c) {
+    return (c >= '!' && c <= '/') || (c >= ':' && c <= '@') || (c >= '[' && c <= '`') || (c >= '{' && c <= '~');
+}
+
+// Classifies a delimiter run with the CommonMark flanking rules; the edges
+// of the block count as whitespace.
+DelimiterRun MakeRun(std::string_view input, size_t start, size_t length) {
+    char marker = input[start];
+    char before = start > 0 ? input[start - 1] : '\n';
+    char after = start + length < input.size() ? input[start + length] : '\n';
+
+    bool leftFlanking = !IsSpace(after) && (!IsPunctuation(after) || IsSpace(before) || IsPunctuation(before));
+    bool rightFlanking = !IsSpace(before) && (!IsPunctuation(before) || IsSpace(after) || IsPunctuation(after));
+
+    DelimiterRun run;
+    run.start = start;
+    run.length = length;
+    run.marker = marker;
+    if (marker == '*') {
+        run.canOpen = leftFlanking;
+        run.canClose = rightFlanking;
+    } else {
+        run.canOpen = leftFlanking && (!rightFlanking || IsPunctuation(before));
+        run.canClose = rightFlanking && (!leftFlanking || IsPunctuation(after));
+    }
+    return run;
+}
+
+// Adds a block's delimiter pass to the emphasis row of RuleStats.
+#ifdef MARKDOWN_RULE_STATS
+void CountEmphasis(const InlineScratch& scratch, uint64_t ns) {
+    RuleCounters& counters = RuleStats::Local(RuleId::Emphasis);
+    counters.calls += scratch.runs.size();
+    counters.ns += ns;
+    for (const DelimiterRun& run : scratch.runs) {
+        counters.bytesScanned += run.length;
+        if (run.firstOpen >= 0 || run.firstClose >= 0) {
+            counters.hits++;
+        }
+    }
+    for (const EmphasisMatch& match : scratch.matches) {
+        counters.bytesConsumed += 2 * match.length;
+    }
+}
+#endif
+
+// Pairs openers with closers using a stack of potential openers. A failed
+// search records how far down it looked for its kind of closer, so the
+// same openers are never searched twice and the pass stays linear.
+void MatchEmphasis(InlineScratch& scratch) {
+    std::vector<DelimiterRun>& runs = scratch.runs;
+    std::vector<uint32_t>& openers = scratch.openers;
+    openers.clear();
+
+    // Indexed by marker, whether the closer can open, and its length mod 3.
+    size_t bottom[2][2][3] = {};
+
+    for (uint32_t r = 0; r < runs.size(); ++r) {
+        DelimiterRun& closer = runs[r];
+
+        if (closer.canClose) {
+            size_t& floor = bottom[closer.marker == '_'][closer.canOpen][closer.length % 3];
+
+            while (closer.closeUsed + closer.openUsed < closer.length) {
+                size_t found = openers.size();
+                for (size_t k = openers.size(); k > floor; --k) {
+                    const DelimiterRun& opener = runs[openers[k - 1]];
+                    if (opener.marker != closer.marker) {
+                        continue;
+                    }
+                    // The "rule of 3" for runs that can both open and close.
+                    bool ambiguous = opener.canClose || closer.canOpen;
+                    if (ambiguous && (opener.length + closer.length) % 3 == 0 &&
+                        (opener.length % 3 != 0 || closer.length % 3 != 0)) {
+                        continue;
+                    }
+                    found = k - 1;
+                    break;
+                }
+
+                if (found == openers.size()) {
+                    floor = openers.size();
+                    break;
+                }
+
+                DelimiterRun& opener = runs[openers[found]];
+                size_t openerLeft = opener.length - opener.closeUsed - opener.openUsed;
+                size_t closerLeft = closer.length - closer.closeUsed - closer.openUsed;
+                size_t length = openerLeft >= 2 && closerLeft >= 2 ? 2 : 1;
+
+                EmphasisMatch match;
+                match.length = length;
+                match.openPos = opener.start + opener.length - opener.openUsed - length;
+                match.closePos = closer.start + closer.closeUsed;
+                int32_t id = static_cast<int32_t>(scratch.matches.size());
+
+                // Later matches on an opener wrap the earlier ones, so they
+                // go first; on a closer they come after.
+                match.nextOpen = opener.firstOpen;
+                opener.firstOpen = id;
+                if (closer.lastClose < 0) {
+                    closer.firstClose = id;
+                } else {
+                    scratch.matches[closer.lastClose].nextClose = id;
+                }
+                closer.lastClose = id;
+                scratch.matches.push_back(match);
+
+                opener.openUsed += length;
+                closer.closeUsed += length;
+
+                // Delimiters between the pair can no longer match anything.
+                openers.resize(opener.closeUsed + opener.openUsed < opener.length ? found + 1 : found);
+                for (auto& byMarker : bottom) {
+                    for (auto& byOpen : byMarker) {
+                        for (size_t& level : byOpen) {
+                            level = std::min(level, openers.size());
+                        }
+                    }
+                }
+            }
+        }
+
+        if (closer.canOpen && closer.closeUsed + closer.openUsed < closer.length) {
+            openers.push_back(r);
+        }
+    }
+}
+
+} // namespace
+
+InlineLexer::InlineLexer() : dispatch(InlineRules::Dispatch()) {
+#if MARKDOWN_RULE_EMPHASIS
+    dispatch['*'] |= kDelimiter;
+    dispatch['_'] |= kDelimiter;
+#endif
+}
+
+const InlineLexer& InlineLexer::Instance() {
+    static const InlineLexer instance;
+    return instance;
+}
+
+void InlineLexer::Tokenize(std::string_view input, Document& doc) const {
+    Tokenize(input, doc, nullptr);
+}
+
+void InlineLexer::Tokenize(std::string_view input, Document& doc, const StructuralIndex& index) const {
+    Tokenize(input, doc, &index);
+}
+
+// Two passes over the block. The first collects rule tokens and delimiter
+// runs; the second pairs delimiters into emphasis with MatchEmphasis and
+// writes the nodes, nesting whatever lies between a pair under it. Both
+// passes are linear in the length of the block.
+void InlineLexer::Tokenize(std::string_view input, Document& doc, const StructuralIndex* index) const {
+    if (input.empty()) {
+        return;
+    }
+
+    thread_local InlineScratch scratch;
+    scratch.items.clear();
+    scratch.runs.clear();
+    scratch.matches.clear();
+
+    size_t offset = static_cast<size_t>(input.data() - doc.Source().data());
+    size_t pos = 0;
+
+    while (pos < input.size()) {
+        if (index != nullptr) {
+            pos = index->NextStructural(offset + pos) - offset;
+            if (pos >= input.size()) {
+                break;
+            }
+        }
+
+        uint8_t candidates = dispatch[static_cast<unsigned char>(input[pos])];
+        if (candidates == 0) {
+            pos++;
+            continue;
+        }
+
+        size_t start = pos;
+        std::optional<Token> token = InlineRules::TryParse(candidates, input, pos);
+        if (token) {
+            scratch.items.push_back(InlineItem{start, pos, *token, -1});
+            continue;
+        }
+
+        if ((candidates & kDelimiter) != 0) {
+            size_t end = pos + 1;
+            while (end < input.size() && input[end] == input[pos]) {
+                end++;
+            }
+            scratch.items.push_back(InlineItem{pos, end, Token(), static_cast<int32_t>(scratch.runs.size())});
+            scratch.runs.push_back(MakeRun(input, pos, end - pos));
+            pos = end;
+        } else {
+            pos++;
+        }
+    }
+
+    if (!scratch.runs.empty()) {
+#ifdef MARKDOWN_RULE_STATS
+        uint64_t started = RuleStats::Now();
+        MatchEmphasis(scratch);
+        CountEmphasis(scratch, RuleStats::Now() - started);
+#else
+        MatchEmphasis(scratch);
+#endif
+    }
+
+    // Text accumulates from textStart until a node has to be written.
+    size_t textStart = 0;
+    auto flushText = [&](size_t end) {
+        if (textStart < end) {
+            doc.Append(Token(Type::Text, input.substr(textStart, end - textStart), "", textStart, end), offset);
+        }
+    };
+
+    for (const InlineItem& item : scratch.items) {
+        if (item.run < 0) {
+            flushText(item.start);
+            doc.Append(item.token, offset);
+            textStart = item.end;
+            continue;
+        }
+
+        const DelimiterRun& run = scratch.runs[item.run];
+
+        for (int32_t m = run.firstClose; m >= 0; m = scratch.matches[m].nextClose) {
+            const EmphasisMatch& match = scratch.matches[m];
+            flushText(match.closePos);
+            doc.Close(match.node);
+            textStart = match.closePos + match.length;
+        }
+
+        for (int32_t m = run.firstOpen; m >= 0; m = scratch.matches[m].nextOpen) {
+            EmphasisMatch& match = scratch.matches[m];
+            flushText(match.openPos);
+            size_t contentStart = match.openPos + match.length;
+            match.node = doc.Append(Token(match.length == 2 ? Type::Bold : Type::Italic,
+                                          input.substr(contentStart, match.closePos - contentStart),
+                                          input.substr(match.openPos, match.length), match.openPos,
+                                          match.closePos + match.length),
+                                    offset);
+            textStart = contentStart;
+        }
+    }
+
+    flushText(input.size());
+}
@@ -0,0 +1,117 @@
+#include "input_file.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+InputFile::~InputFile() {
+    Release();
+}
+
+InputFile::InputFile(InputFile&& other) noexcept
+    : mapping(other.mapping), mappedSize(other.mappedSize), buffer(std::move(other.buffer)) {
+    other.mapping = nullptr;
+    other.mappedSize = 0;
+}
+
+InputFile& InputFile::operator=(InputFile&& other) noexcept {
+    if (this != &other) {
+        Release();
+        mapping = other.mapping;
+        mappedSize = other.mappedSize;
+        buffer = std::move(other.buffer);
+        other.mapping = nullptr;
+        other.mappedSize = 0;
+    }
+    return *this;
+}
+
+void InputFile::Release() {
+    if (mapping != nullptr) {
+        munmap(mapping, mappedSize);
+        mapping = nullptr;
+        mappedSize = 0;
+    }
+    buffer.clear();
+}
+
+bool InputFile::Open(const std::string& path, std::string& error, bool populate) {
+    Release();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        error = "Could not open file: " + path + " (" + std::strerror(errno) + ")";
+        return false;
+    }
+
+    bool ok = Open(fd, path, error, populate);
+    ::close(fd);
+    return ok;
+}
+
+bool InputFile::Open(int fd, const std::string& path, std::string& error, bool populate) {
+    Release();
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        error = "Could not stat file: " + path + " (" + std::strerror(errno) + ")";
+        return false;
+    }
+
+    bool ok = true;
+    if (S_ISREG(info.st_mode) && info.st_size > 0) {
+        size_t size = static_cast<size_t>(info.st_size);
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | (populate ? MAP_POPULATE : 0), fd, 0);
+        if (mapped != MAP_FAILED) {
+            madvise(mapped, size, MADV_SEQUENTIAL);
+            mapping = mapped;
+            mappedSize = size;
+        } else {
+            ok = ReadAll(fd, size, error);
+        }
+    } else if (!S_ISREG(info.st_mode)) {
+        ok = ReadAll(fd, 0, error);
+    }
+
+    if (!ok) {
+        error = "Could not read file: " + path + " (" + error + ")";
+    }
+    return ok;
+}
+
+void InputFile::Assign(std::string data) {
+    Release();
+    buffer = std::move(data);
+}
+
+bool InputFile::ReadAll(int fd, size_t sizeHint, std::string& error) {
+    // One spare byte lets a file of the expected size finish in one read plus
+    // the zero-length read that confirms end of file.
+    buffer.resize(sizeHint > 0 ? sizeHint + 1 : 64 * 1024);
+    size_t used = 0;
+
+    while (true) {
+        if (used == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+
+        ssize_t n = ::read(fd, &buffer[used], buffer.size() - used);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = std::strerror(errno);
+            buffer.clear();
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        used += static_cast<size_t>(n);
+    }
+
+    buffer.resize(used);
+    return true;
+}
@@ -0,0 +1,291 @@
+#include "io_ring.h"
+
+#ifdef MARKDOWN_IO_URING
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+int Setup(unsigned entries, io_uring_params& params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+}
+
+int Enter(int fd, unsigned submit, unsigned wait) {
+    return static_cast<int>(
+        syscall(__NR_io_uring_enter, fd, submit, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+}
+
+int Register(int fd, unsigned opcode, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+unsigned* At(void* ring, unsigned offset) {
+    return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+}
+
+} // namespace
+
+IoRing::~IoRing() {
+    Shutdown();
+}
+
+void IoRing::Shutdown() {
+    if (sqes != nullptr) {
+        munmap(sqes, sqesSize);
+    }
+    if (cqRing != nullptr && cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != nullptr) {
+        munmap(sqRing, sqRingSize);
+    }
+    if (ringFd >= 0) {
+        ::close(ringFd);
+    }
+    ringFd = -1;
+    sqRing = cqRing = sqes = nullptr;
+    sqEntries = fileSlots = queued = 0;
+}
+
+bool IoRing::Open(unsigned entries, unsigned slots, std::string& error) {
+    Shutdown();
+
+    // Keep submitting past a failed operation, and only run completion work
+    // when we enter the kernel anyway; older kernels get neither.
+    io_uring_params params{};
+    params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    int fd = Setup(entries, params);
+    if (fd < 0 && errno == EINVAL) {
+        params = io_uring_params{};
+        fd = Setup(entries, params);
+    }
+    if (fd < 0) {
+        error = std::string("io_uring is unavailable (") + std::strerror(errno) + ")";
+        return false;
+    }
+    ringFd = fd;
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) {
+        sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        sqRing = nullptr;
+    } else if (single) {
+        cqRing = sqRing;
+    } else {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        cqRing = cqRing == MAP_FAILED ? nullptr : cqRing;
+    }
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqes = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    sqes = sqes == MAP_FAILED ? nullptr : sqes;
+    if (sqRing == nullptr || cqRing == nullptr || sqes == nullptr) {
+        error = std::string("Could not map the io_uring queues (") + std::strerror(errno) + ")";
+        Shutdown();
+        return false;
+    }
+
+    sqHead = At(sqRing, params.sq_off.head);
+    sqTail = At(sqRing, params.sq_off.tail);
+    sqMask = At(sqRing, params.sq_off.ring_mask);
+    sqArray = At(sqRing, params.sq_off.array);
+    cqHead = At(cqRing, params.cq_off.head);
+    cqTail = At(cqRing, params.cq_off.tail);
+    cqMask = At(cqRing, params.cq_off.ring_mask);
+    cqes = static_cast<char*>(cqRing) + params.cq_off.cqes;
+    sqEntries = params.sq_entries;
+    localTail = *sqTail;
+
+    // Empty descriptor slots for OpenAt to fill.
+    std::vector<int> empty(slots, -1);
+    if (slots > 0 && Register(fd, IORING_REGISTER_FILES, empty.data(), slots) < 0) {
+        error = std::string("Could not register io_uring file slots (") + std::strerror(errno) + ")";
+        Shutdown();
+        return false;
+    }
+    fileSlots = slots;
+    return true;
+}
+
+bool IoRing::RegisterBuffers(const iovec* buffers, unsigned count, std::string& error) {
+    if (Register(ringFd, IORING_REGISTER_BUFFERS, buffers, count) < 0) {
+        error = std::string("Could not register io_uring buffers (") + std::strerror(errno) + ")";
+        return false;
+    }
+    return true;
+}
+
+void* IoRing::Next(uint8_t opcode, bool link) {
+    if (ringFd < 0 || localTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+        return nullptr;
+    }
+
+    unsigned index = localTail & *sqMask;
+    io_uring_sqe* sqe = static_cast<io_uring_sqe*>(sqes) + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    // A hard link keeps the chain going when this operation fails.
+    sqe->flags = link ? IOSQE_IO_HARDLINK : 0;
+    sqArray[index] = index;
+    ++localTail;
+    ++queued;
+    return sqe;
+}
+
+bool IoRing::Statx(const char* path, struct statx* out, uint64_t tag) {
+    auto* sqe = static_cast<io_uring_sqe*>(Next(IORING_OP_STATX, false));
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64_t>(path);
+    sqe->len = STATX_TYPE | STATX_SIZE;
+    sqe->off = reinterpret_cast<uint64_t>(out);
+    sqe->user_data = tag;
+    return true;
+}
+
+bool IoRing::OpenAt(const char* path, int flags, mode_t mode, unsigned slot, uint64_t tag, bool link) {
+    auto* sqe = static_cast<io_uring_sqe*>(Next(IORING_OP_OPENAT, link));
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64_t>(path);
+    sqe->len = mode;
+    sqe->open_flags = static_cast<uint32_t>(flags);
+    sqe->file_index = slot + 1;
+    sqe->user_data = tag;
+    return true;
+}
+
+bool IoRing::Read(unsigned slot, void* data, uint32_t size, uint64_t offset, uint64_t tag, bool link) {
+    auto* sqe = static_cast<io_uring_sqe*>(Next(IORING_OP_READ, link));
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->flags |= IOSQE_FIXED_FILE;
+    sqe->fd = static_cast<int>(slot);
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->user_data = tag;
+    return true;
+}
+
+bool IoRing::Write(unsigned slot, const void* data, uint32_t size, uint64_t offset, uint64_t tag, bool link,
+                   int buffer) {
+    auto* sqe = static_cast<io_uring_sqe*>(Next(buffer >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE, link));
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->flags |= IOSQE_FIXED_FILE;
+    sqe->fd = static_cast<int>(slot);
+    sqe->addr = reinterpret_cast<uint64_t>(data);
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->buf_index = static_cast<uint16_t>(buffer >= 0 ? buffer : 0);
+    sqe->user_data = tag;
+    return true;
+}
+
+bool IoRing::Close(unsigned slot, uint64_t tag) {
+    auto* sqe = static_cast<io_uring_sqe*>(Next(IORING_OP_CLOSE, false));
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->file_index = slot + 1;
+    sqe->user_data = tag;
+    return true;
+}
+
+bool IoRing::Run(std::vector<Completion>& completions, std::string& error) {
+    __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+
+    unsigned submit = queued;
+    unsigned pending = queued;
+    queued = 0;
+    while (true) {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail && pending > 0; ++head, --pending) {
+            const io_uring_cqe& cqe = static_cast<const io_uring_cqe*>(cqes)[head & *cqMask];
+            completions.push_back({cqe.user_data, cqe.res});
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        if (pending == 0) {
+            break;
+        }
+
+        // Usually a single entry submits the batch and waits for all of it.
+        int entered = Enter(ringFd, submit, pending);
+        if (entered < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            error = std::string("io_uring_enter failed (") + std::strerror(errno) + ")";
+            Shutdown();
+            return false;
+        }
+        if (entered > 0) {
+            submit -= std::min<unsigned>(submit, static_cast<unsigned>(entered));
+        }
+    }
+    return true;
+}
+
+#else
+
+IoRing::~IoRing() = default;
+
+void IoRing::Shutdown() {}
+
+bool IoRing::Open(unsigned, unsigned, std::string& error) {
+    error = "built without io_uring (MARKDOWN_IO_URING)";
+    return false;
+}
+
+bool IoRing::RegisterBuffers(const iovec*, unsigned, std::string&) {
+    return false;
+}
+
+void* IoRing::Next(uint8_t, bool) {
+    return nullptr;
+}
+
+bool IoRing::Statx(const char*, struct statx*, uint64_t) {
+    return false;
+}
+
+bool IoRing::OpenAt(const char*, int, mode_t, unsigned, uint64_t, bool) {
+    return false;
+}
+
+bool IoRing::Read(unsigned, void*, uint32_t, uint64_t, uint64_t, bool) {
+    return false;
+}
+
+bool IoRing::Write(unsigned, const void*, uint32_t, uint64_t, uint64_t, bool, int) {
+    return false;
+}
+
+bool IoRing::Close(unsigned, uint64_t) {
+    return false;
+}
+
+bool IoRing::Run(std::vector<Completion>&, std::string& error) {
+    error = "built without io_uring (MARKDOWN_IO_URING)";
+    return false;
+}
+
+#endif
@@ -1,121 +1,269 @@
 #include "lexer.h"
+#include "inline_lexer.h"
+#include "structural_index.h"
 #include "heading_rule.h"
-#include "code_rule.h"
-#include "bold_rule.h"
-#include "italic_rule.h"
-#include "link_rule.h"
 #include "list_rule.h"
-#include "horizontalline_rule.h"
-#include <memory>
-#include <vector>
+#include "rule_pipeline.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
 #include <string_view>
 
-std::vector<Token> TokenizeInline(std::string_view input) {
-    std::vector<Token> tokens;
-    std::vector<std::unique_ptr<IRule>> inlineRules;
-    inlineRules.push_back(std::make_unique<CodeRule>());
-    inlineRules.push_back(std::make_unique<LinkRule>());
-    inlineRules.push_back(std::make_unique<BoldRule>());
-    inlineRules.push_back(std::make_unique<ItalicRule>());
-    inlineRules.push_back(std::make_unique<HorizontalRule>());
+// Block rules, in priority order. They only match at the start of a line.
+using BlockRules = MakePipeline<RuleIf<MARKDOWN_RULE_HEADING, HeadingRule>,
+                                RuleIf<MARKDOWN_RULE_LIST, ListRule>>::type;
 
-    size_t pos = 0;
-    size_t textStart = 0;
-    bool inText = false;
+// One slot per node; a slot is filled the first time Inlines() asks for it.
+struct Document::InlineCache {
+    explicit InlineCache(size_t count) : blocks(new std::atomic<const Document*>[count]), count(count) {
+        for (size_t i = 0; i < count; ++i) {
+            blocks[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+    ~InlineCache() {
+        for (size_t i = 0; i < count; ++i) {
+            delete blocks[i].load(std::memory_order_relaxed);
+        }
+    }
 
-    while (pos < input.size()) {
-        bool matched = false;
-        for (auto& rule : inlineRules) {
-            if (rule->Match(input, pos)) {
-                if (inText && textStart < pos) {
-                    tokens.push_back(Token(Type::Text, input.substr(textStart, pos - textStart), "", textStart, pos));
-                    inText = false;
-                }
-
-                Token token = rule->Parse(input, pos);
-                tokens.push_back(token);
-                textStart = pos;
-                matched = true;
-                break;
+    std::unique_ptr<std::atomic<const Document*>[]> blocks;
+    size_t count;
+};
+
+const Document& Document::Inlines(uint32_t index) const {
+    // Only documents from TokenizeBlocks have inlines to lex; others nest
+    // them under their blocks.
+    assert(deferred && index < deferred->count);
+    std::atomic<const Document*>& slot = deferred->blocks[index];
+    const Document* cached = slot.load(std::memory_order_acquire);
+    if (cached != nullptr) {
+        return *cached;
+    }
+
+    auto lexed = std::make_unique<Document>(source);
+    const Node& block = nodes[index];
+    if (block.type == Type::Text || block.type == Type::Heading || block.type == Type::listItem) {
+        InlineLexer::Instance().Tokenize(Value(block), *lexed);
+    }
+
+    // Threads that race on a block each lex it; the first result is kept.
+    if (slot.compare_exchange_strong(cached, lexed.get(), std::memory_order_acq_rel, std::memory_order_acquire)) {
+        cached = lexed.release();
+    }
+    return *cached;
+}
+
+uint32_t Document::OffsetOf(std::string_view part) const {
+    if (part.empty()) {
+        return 0;
+    }
+    return static_cast<uint32_t>(part.data() - source.data());
+}
+
+uint32_t Document::Append(const Token& token, size_t offset) {
+    uint32_t index = size();
+
+    Node node;
+    node.pos = static_cast<uint32_t>(offset + token.pos);
+    node.max = static_cast<uint32_t>(offset + token.max);
+    node.value = OffsetOf(token.value);
+    node.valueLength = static_cast<uint32_t>(token.value.size());
+    node.meta = OffsetOf(token.meta);
+    node.metaLength = static_cast<uint32_t>(std::min<size_t>(token.meta.size(), kMaxMetaSize));
+    node.type = token.type;
+    node.next = index + 1;
+
+    nodes.push_back(node);
+    return index;
+}
+
+void Document::Splice(uint32_t first, uint32_t last, const Document& replacement, int64_t shift) {
+    int64_t indexShift = static_cast<int64_t>(replacement.size()) - static_cast<int64_t>(last - first);
+
+    for (uint32_t i = last; i < size(); ++i) {
+        Node& node = nodes[i];
+        node.pos = static_cast<uint32_t>(node.pos + shift);
+        node.max = static_cast<uint32_t>(node.max + shift);
+        if (node.valueLength != 0) {
+            node.value = static_cast<uint32_t>(node.value + shift);
+        }
+        if (node.metaLength != 0) {
+            node.meta = static_cast<uint32_t>(node.meta + shift);
+        }
+        node.next = static_cast<uint32_t>(node.next + indexShift);
+    }
+
+    std::vector<Node> inserted(replacement.nodes);
+    for (Node& node : inserted) {
+        node.next += first;
+    }
+
+    nodes.erase(nodes.begin() + first, nodes.begin() + last);
+    nodes.insert(nodes.begin() + first, inserted.begin(), inserted.end());
+    source = replacement.source;
+}
+
+// Lexes the blocks of doc's source from the line start `pos` to the end of
+// the input, or until `stop(pos)` returns true at a block boundary after the
+// first block. Returns where lexing stopped. Without an index, lines are
+// found with memchr and inline content is lexed without skipping. Without
+// `inlines`, blocks get no children.
+template <typename Stop>
+static size_t LexBlocks(Document& doc, size_t pos, const StructuralIndex* index, bool inlines, Stop stop) {
+    // Block rules only match at the start of a line, so the block stage walks
+    // from newline to newline and never looks at the bytes in between.
+    const InlineLexer& inlineLexer = InlineLexer::Instance();
+    std::string_view input = doc.Source();
+
+    auto appendBlock = [&](const Token& token) {
+        uint32_t block = doc.Append(token);
+        if (inlines && (token.type == Type::Text || token.type == Type::Heading || token.type == Type::listItem)) {
+            if (index != nullptr) {
+                inlineLexer.Tokenize(token.value, doc, *index);
+            } else {
+                inlineLexer.Tokenize(token.value, doc);
             }
+            doc.Close(block);
+        }
+    };
+
+    auto nextLine = [&](size_t from) {
+        if (index != nullptr) {
+            return index->NextNewline(from) + 1;
+        }
+        const void* found = std::memchr(input.data() + from, '\n', input.size() - from);
+        return found == nullptr ? input.size() + 1 : static_cast<size_t>(static_cast<const char*>(found) - input.data()) + 1;
+    };
+
+    const size_t start = pos;
+    size_t textStart = pos;
+
+    while (pos < input.size()) {
+        if (textStart == pos && pos != start && stop(pos)) {
+            return pos;
+        }
+
+        size_t blockStart = pos;
+        std::optional<Token> block = BlockRules::TryParse(BlockRules::kAll, input, pos);
+        if (!block) {
+            pos = nextLine(pos);
+            continue;
         }
 
-        if (!matched) {
-            if (!inText) {
-                textStart = pos;
-                inText = true;
+        if (textStart < blockStart) {
+            appendBlock(Token(Type::Text, input.substr(textStart, blockStart - textStart), "", textStart, blockStart));
+            if (stop(blockStart)) {
+                return blockStart;
             }
-            pos++;
         }
+
+        appendBlock(*block);
+        textStart = pos;
     }
 
-    if (inText && textStart < input.size()) {
-        tokens.push_back(Token(Type::Text, input.substr(textStart, input.size() - textStart), "", textStart, input.size()));
+    if (textStart < input.size()) {
+        appendBlock(Token(Type::Text, input.substr(textStart, input.size() - textStart), "", textStart, input.size()));
     }
 
-    return tokens;
+    return input.size();
 }
 
-std::vector<Token> Lexer::Tokenize(std::string_view input) {
+Document Lexer::Tokenize(std::string_view input) {
+    if (input.size() > Document::kMaxSourceSize) {
+        throw std::length_error("markdown input exceeds 4 GiB");
+    }
+
+    Document doc(input);
+
     if(input.empty()) {
-        return { Token(Type::EndOfFile, "", "", 0, 0) };
+        doc.Append(Token(Type::EndOfFile, "", "", 0, 0));
+        return doc;
     }
 
-    std::vector<Token> tokens;
+    // Typical documents produce about one node per 13 bytes; reserving for
+    // one per 12 keeps the node array to a single allocation.
+    doc.Reserve(input.size() / 12 + 16);
 
-    std::vector<std::unique_ptr<IRule>> blockRules;
-    blockRules.push_back(std::make_unique<HeadingRule>());
-    blockRules.push_back(std::make_unique<ListRule>());
+    StructuralIndex index(input);
+    LexBlocks(doc, 0, &index, true, [](size_t) { return false; });
 
-    size_t pos = 0;
-    size_t textStart = 0;
-    bool inText = false;
+    doc.Append(Token(Type::EndOfFile, "", "", input.size(), input.size()));
 
-    while (pos < input.size()) {
-        bool matched = false;
-
-        for (auto& rule : blockRules) {
-            if (rule->Match(input, pos)) {
-                if (inText && textStart < pos) {
-                    std::string_view textContent = input.substr(textStart, pos - textStart);
-                    auto inlineTokens = TokenizeInline(textContent);
-                    tokens.push_back(Token(Type::Text, textContent, "", textStart, pos));
-                    tokens.back().children = std::move(inlineTokens);
-                    inText = false;
-                }
-
-                Token token = rule->Parse(input, pos);
-
-                if (token.type == Type::Heading || token.type == Type::listItem) {
-                    auto inlineTokens = TokenizeInline(token.value);
-                    token.children = std::move(inlineTokens);
-                }
-
-                tokens.push_back(token);
-                textStart = pos;
-                matched = true;
-                break;
-            }
-        }
+    return doc;
+}
 
-        if (!matched) {
-            if (!inText) {
-                textStart = pos;
-                inText = true;
-            }
-            pos++;
-        }
+Document Lexer::TokenizeBlocks(std::string_view input) {
+    if (input.size() > Document::kMaxSourceSize) {
+        throw std::length_error("markdown input exceeds 4 GiB");
+    }
+
+    Document doc(input);
+
+    // The block pass only looks at line starts, so memchr finds them faster
+    // than building the structural index would.
+    if (!input.empty()) {
+        LexBlocks(doc, 0, nullptr, false, [](size_t) { return false; });
     }
 
-    if (inText && textStart < input.size()) {
-        std::string_view textContent = input.substr(textStart, input.size() - textStart);
-        auto inlineTokens = TokenizeInline(textContent);
-        Token token(Type::Text, textContent, "", textStart, input.size());
-        token.children = std::move(inlineTokens);
-        tokens.push_back(std::move(token));
+    doc.Append(Token(Type::EndOfFile, "", "", input.size(), input.size()));
+    doc.deferred = std::make_shared<Document::InlineCache>(doc.size());
+    return doc;
+}
+
+BlockRange Lexer::Retokenize(Document& doc, std::string_view input, const Edit& edit) {
+    if (input.size() > Document::kMaxSourceSize) {
+        throw std::length_error("markdown input exceeds 4 GiB");
     }
 
-    tokens.push_back(Token(Type::EndOfFile, "", "", input.size(), input.size()));
+    const int64_t shift = static_cast<int64_t>(edit.inserted) - static_cast<int64_t>(edit.removed);
+    const size_t oldEditEnd = edit.offset + edit.removed;
+    const size_t newEditEnd = edit.offset + edit.inserted;
+
+    // Restart one block before the block holding the byte ahead of the edit:
+    // whether a line opens a block depends on that line, so the start of the
+    // block before it is the nearest boundary the edit cannot move.
+    uint32_t first = 0;
+    uint32_t previous = 0;
+    size_t probe = edit.offset > 0 ? edit.offset - 1 : 0;
+    for (uint32_t i = 0; i < doc.size() && doc[i].type != Type::EndOfFile && doc[i].pos <= probe; i = doc[i].next) {
+        previous = first;
+        first = i;
+    }
+    first = previous;
 
-    return tokens;
+    // Old top-level boundaries after the edit, visited in order while the new
+    // tokens are produced; lexing stops at the first one both agree on.
+    uint32_t oldCursor = first;
+    auto resynchronized = [&](size_t pos) {
+        if (pos <= newEditEnd) {
+            return false;
+        }
+        size_t oldPos = static_cast<size_t>(static_cast<int64_t>(pos) - shift);
+        while (oldCursor < doc.size() && doc[oldCursor].type != Type::EndOfFile &&
+               (doc[oldCursor].pos < oldPos || doc[oldCursor].pos <= oldEditEnd)) {
+            oldCursor = doc[oldCursor].next;
+        }
+        return oldCursor < doc.size() && doc[oldCursor].type != Type::EndOfFile && doc[oldCursor].pos == oldPos;
+    };
+
+    Document replacement(input);
+    size_t start = first < doc.size() ? std::min<size_t>(doc[first].pos, input.size()) : 0;
+    size_t stopped = LexBlocks(replacement, start, nullptr, !doc.InlinesDeferred(), resynchronized);
+
+    uint32_t oldEnd = doc.size();
+    if (stopped >= input.size()) {
+        replacement.Append(Token(Type::EndOfFile, "", "", input.size(), input.size()));
+    } else {
+        oldEnd = oldCursor;
+    }
+
+    doc.Splice(first, oldEnd, replacement, shift);
+    if (doc.InlinesDeferred()) {
+        // Node indices moved; blocks are lexed again on their next use.
+        doc.deferred = std::make_shared<Document::InlineCache>(doc.size());
+    }
+    return BlockRange{first, oldEnd, first + replacement.size()};
 }
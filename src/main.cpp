@@ -1,40 +1,133 @@
 #include <iostream>
-#include <fstream>
+#include <iomanip>
 #include <string>
 #include <thread>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <map>
+#include <set>
+#include <fstream>
+#include <functional>
 #include <filesystem>
 #include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include "build_cache.h"
+#include "content_hash.h"
+#include "document_shell.h"
+#include "file_pipeline.h"
+#include "input_file.h"
+#include "stream_renderer.h"
 #include "lexer.h"
+#include "metrics.h"
 #include "parser.h"
+#include "render_server.h"
+#include "renderer.h"
+#include "rule_stats.h"
+#include "worker_pool.h"
+
+#ifndef MARKDOWN_ENGINE_VERSION
+#define MARKDOWN_ENGINE_VERSION "dev"
+#endif
 
-struct FileContent
+struct EngineOptions
 {
-    std::string content;
-    bool success;
-    std::string error;
+    size_t jobs = 0;
+    bool stream = false;
+    // Read-ahead budget: input and output of files between read and write.
+    uint64_t maxInFlightBytes = 256ull << 20;
+    bool ioRing = true;
+    ShellMode shellMode = ShellMode::InlineStyle;
+    std::string stylesheet = "utils/formatting.css";
+    std::string templatePath;
+    std::string outputDir;
+    // Tree mode: every .md/.mdx under inputDir, mirrored into outputDir.
+    std::string inputDir;
+    std::string manifestPath;
+    std::string cacheDir;
+    MetricsFormat metrics = MetricsFormat::Off;
+    std::string metricsPath;
+    bool ruleStats = false;
+    // Daemon mode: framed requests on stdin/stdout, or on a Unix socket.
+    bool serve = false;
+    std::string socketPath;
+};
+
+enum class FileStatus
+{
+    Rendered,
+    UpToDate,
+    Failed,
+    // Not rendered: another source in the same directory maps to the same output.
+    Skipped
+};
+
+struct FileOutcome
+{
+    FileStatus status = FileStatus::Failed;
+    uint64_t inputBytes = 0;
+    uint64_t outputBytes = 0;
+};
+
+struct ManifestEntry
+{
+    std::string input;
+    std::string output;
+    FileOutcome outcome;
 };
 
 class Manager
 {
-    std::atomic<int> i{0};
-    std::string css()
+    EngineOptions options;
+    const DocumentShell &shell;
+    Renderer renderer;
+    std::ostream &log;
+    const BuildCache *cache;
+    MetricsCollector *metrics;
+    WorkerPool *pool;
+    // Stages are only timed when metrics are collected.
+    bool measure;
+    std::mutex manifestMutex;
+    std::vector<ManifestEntry> manifest;
+    // Every output path queued so far, from the command line or the tree.
+    std::mutex outputsMutex;
+    std::set<std::filesystem::path> claimedOutputs;
+    std::atomic<size_t> filesProcessed{0};
+    std::atomic<size_t> filesUpToDate{0};
+    std::atomic<size_t> filesFailed{0};
+    std::atomic<size_t> filesSkipped{0};
+    std::atomic<uint64_t> bytesProcessed{0};
+    // Last, so that it finishes its jobs before anything they use goes away.
+    std::unique_ptr<FilePipeline> pipeline;
+    // Stable mapping: docs/intro.md becomes docs/intro.html, or
+    // <out-dir>/intro.html when an output directory is set.
+    std::string outputPathFor(const std::string &filename)
     {
-        std::ifstream cssFile("utils/formatting.css");
-        if (!cssFile.is_open())
+        std::filesystem::path input(filename);
+        std::filesystem::path output = options.outputDir.empty()
+                                           ? input
+                                           : std::filesystem::path(options.outputDir) / input.filename();
+        if (output.extension() == ".html")
         {
-            return "/* Could not load CSS file */";
+            output += ".html";
         }
-        std::stringstream buffer;
-        buffer << cssFile.rdbuf();
-        return buffer.str();
+        else
+        {
+            output.replace_extension(".html");
+        }
+        return output.string();
     }
 
-    std::string fileSize(const FileContent &fileContent)
+    std::string fileSize(size_t size)
     {
         const char *units[] = {"B", "KB", "MB", "GB", "TB"};
-        size_t size = fileContent.content.size();
         int unitIndex = 0;
 
         while (size >= 1024 && unitIndex < 4)
@@ -46,36 +139,7 @@ class Manager
         return std::to_string(size) + " " + units[unitIndex];
     }
 
-    [[nodiscard]] FileContent readFile(const std::string &filename)
-    {
-        FileContent result;
-        result.success = false;
-
-        // remove path problems
-        std::filesystem::path filepath = std::filesystem::absolute(filename);
-
-        if (std::filesystem::exists(filepath) == false)
-        {
-            result.error = "Path does not exist: " + filename;
-            return result;
-        }
-
-        std::ifstream file(filepath);
-        if (!file.is_open())
-        {
-            result.error = "Could not open file: " + filename;
-            return result;
-        }
-
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        result.content = buffer.str();
-        result.success = true;
-
-        return result;
-    }
-
-    void printTokens(const std::vector<Token> &tokens)
+    void printTokens(const Document &doc)
     {
         const char *typeNames[] = {
             "Heading",
@@ -92,56 +156,64 @@ class Manager
             "EndOfFile"};
 
         std::cout << "\n=== Tokenization Results ===\n";
-        std::cout << "Total tokens: " << tokens.size() << "\n\n";
+        std::cout << "Total tokens: " << doc.size() << "\n\n";
 
-        for (const auto &token : tokens)
+        for (uint32_t i = 0; i < doc.size(); i = doc[i].next)
         {
+            const Node &token = doc[i];
+            std::string_view value = doc.Value(token);
+            std::string_view meta = doc.Meta(token);
+
             std::cout << "Type: " << typeNames[static_cast<int>(token.type)];
 
-            if (!token.value.empty())
+            if (!value.empty())
             {
                 std::cout << " | Value: \"";
-                if (token.value.length() > 50)
+                if (value.length() > 50)
                 {
-                    std::cout << token.value.substr(0, 47) << "...";
+                    std::cout << value.substr(0, 47) << "...";
                 }
                 else
                 {
-                    std::cout << token.value;
+                    std::cout << value;
                 }
                 std::cout << "\"";
             }
 
-            if (!token.meta.empty())
+            if (!meta.empty())
             {
-                std::cout << " | Meta: \"" << token.meta << "\"";
+                std::cout << " | Meta: \"" << meta << "\"";
             }
 
             std::cout << " | Pos: [" << token.pos << "-" << token.max << "]\n";
 
-            if (!token.children.empty())
+            if (doc.HasChildren(i))
             {
                 std::cout << "  Children Tokens: ";
-                for (const auto &child : token.children)
+                for (uint32_t c = doc.FirstChild(i); c < doc.ChildrenEnd(i); c = doc[c].next)
                 {
+                    const Node &child = doc[c];
+                    std::string_view childValue = doc.Value(child);
+                    std::string_view childMeta = doc.Meta(child);
+
                     std::cout << "    Type: " << typeNames[static_cast<int>(child.type)];
 
-                    if (!child.value.empty())
+                    if (!childValue.empty())
                     {
                         std::cout << " | Value: ";
-                        if (child.value.length() > 50)
+                        if (childValue.length() > 50)
                         {
-                            std::cout << child.value.substr(0, 47) << "...";
+                            std::cout << childValue.substr(0, 47) << "...";
                         }
                         else
                         {
-                            std::cout << child.value;
+                            std::cout << childValue;
                         }
                     }
 
-                    if (!child.meta.empty())
+                    if (!childMeta.empty())
                     {
-                        std::cout << " | Meta: \"" << child.meta << "\"";
+                        std::cout << " | Meta: \"" << childMeta << "\"";
                     }
 
                     std::cout << " | Pos: [" << child.pos << "-" << child.max << "]\n";
@@ -150,23 +222,21 @@ class Manager
         }
     }
 
-    void writeToFile(const std::string &filename, const std::string &content)
+public:
+    Manager(const EngineOptions &options, const DocumentShell &shell, const BuildCache *cache = nullptr,
+            WorkerPool *pool = nullptr, std::ostream &log = std::cout, MetricsCollector *metrics = nullptr)
+        : options(options), shell(shell), renderer(pool), log(log), cache(cache), metrics(metrics), pool(pool),
+          measure(metrics != nullptr && metrics->Enabled())
     {
-        std::filesystem::path filePath = std::filesystem::absolute(filename);
-        std::ofstream outFile(filePath);
-        if (outFile.is_open())
+        if (pool != nullptr)
         {
-            outFile << content;
-            outFile.close();
-        }
-        else
-        {
-            std::cerr << "Error: Could not write to file: " << filename << "\n";
+            FilePipeline::Limits limits;
+            limits.maxBytes = options.maxInFlightBytes;
+            limits.ioRing = options.ioRing;
+            pipeline = std::make_unique<FilePipeline>(
+                shell, *pool, [this](FileJob &job) { RenderJob(job); }, limits, measure);
         }
     }
-
-public:
-    Manager() = default;
     ~Manager() = default;
 
     Manager(const Manager &other) = delete;
@@ -183,69 +253,754 @@ public:
         return *this;
     };
 
-    void ProcessFile(const std::string &filename)
+    // Queues a file. Files go through the pipeline; stdin and --stream
+    // render on a worker of their own. record, when set, gets the outcome
+    // once the file is done.
+    // A file whose output is already claimed by another input is skipped.
+    void Add(const std::string &filename, const std::string &outputfile,
+             std::function<void(const FileOutcome &)> record = nullptr)
+    {
+        if (outputfile != "-" && !ClaimOutput(outputfile))
+        {
+            std::cerr << "Error: Skipping " << filename << ": " << outputfile
+                      << " is already rendered from another source\n";
+            FileOutcome skipped;
+            skipped.status = FileStatus::Skipped;
+            Done(skipped, record);
+            return;
+        }
+
+        if (filename == "-" || options.stream)
+        {
+            pool->Submit([this, filename, outputfile, record] {
+                Done(StreamFile(filename, outputfile), record);
+            });
+            return;
+        }
+
+        auto job = std::make_unique<FileJob>();
+        job->input = filename;
+        job->output = outputfile;
+        job->done = [this, record](FileJob &finished) {
+            Done(Complete(finished), record);
+        };
+        pipeline->Add(std::move(job));
+    }
+
+    // Counts files that failed or were skipped, then passes the outcome on.
+    void Done(const FileOutcome &outcome, const std::function<void(const FileOutcome &)> &record)
+    {
+        if (outcome.status == FileStatus::Failed)
+        {
+            filesFailed.fetch_add(1, std::memory_order_relaxed);
+        }
+        else if (outcome.status == FileStatus::Skipped)
+        {
+            filesSkipped.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (record)
+        {
+            record(outcome);
+        }
+    }
+
+    // Takes outputfile for one input; false when another input has it.
+    bool ClaimOutput(const std::string &outputfile)
+    {
+        std::filesystem::path output = std::filesystem::absolute(outputfile).lexically_normal();
+        std::lock_guard<std::mutex> lock(outputsMutex);
+        return claimedOutputs.insert(std::move(output)).second;
+    }
+
+    // Inputs that map to the same output, such as d1/a.md and d2/a.md with
+    // --out-dir, would overwrite each other; such a batch is rejected before
+    // anything is rendered.
+    bool CheckOutputs(const std::vector<std::string> &files)
+    {
+        std::map<std::string, std::string> owners;
+        for (const auto &file : files)
+        {
+            if (file == "-")
+            {
+                continue;
+            }
+            std::string output = std::filesystem::path(outputPathFor(file)).lexically_normal().string();
+            auto [owner, inserted] = owners.emplace(output, file);
+            if (!inserted)
+            {
+                std::cerr << "Error: " << owner->second << " and " << file << " would both write " << output << "\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Add(const std::string &filename)
+    {
+        Add(filename, filename == "-" ? "-" : outputPathFor(filename));
+    }
+
+    // Blocks until every added file is done, including those found by a
+    // directory walk that was still running.
+    void Wait()
+    {
+        pool->Wait();
+        pipeline->Finish();
+    }
+
+    // Render stage of the pipeline, on a pool worker.
+    void RenderJob(FileJob &job)
     {
-        FileContent fileContent = readFile(filename);
+        std::string_view content = job.file.Data();
+        if (cache != nullptr)
+        {
+            job.key = cache->Key(content);
+            if (cache->IsFresh(job.output, job.key))
+            {
+                job.upToDate = true;
+                return;
+            }
+        }
+
+        log << ": Processing file: " << std::filesystem::path(job.input).filename().string()
+                  << ", size: " << fileSize(content.size()) << "\n";
 
-        if (!fileContent.success)
+        if (content.size() > Document::kMaxSourceSize)
         {
             std::cerr << "Thread " << std::this_thread::get_id()
-                      << ": Error: " << fileContent.error << "\n";
+                      << ": Error: File is larger than 4 GB: " << job.input << "\n";
             return;
         }
 
-        std::cout << ": Processing file: " << std::filesystem::path(filename).filename().string()
-                  << ", size: " << fileSize(fileContent) << "\n";
+        BufferSink body(Renderer::EstimateSize(content.size()));
+        RenderStats renderStats;
+        renderer.Render(content, body, measure ? &renderStats : nullptr);
+        job.html = body.Take();
+        job.write = true;
+
+        if (measure)
+        {
+            job.metrics[Stage::Tokenize] = renderStats.tokenize;
+            job.metrics[Stage::Parse] = renderStats.parse;
+            job.metrics.tokens = renderStats.tokens;
+        }
+    }
+
+    // Last stage of the pipeline, on its writer thread once the output has
+    // been written.
+    FileOutcome Complete(FileJob &job)
+    {
+        FileOutcome outcome;
+
+        if (!job.readOk)
+        {
+            std::cerr << "Thread " << std::this_thread::get_id()
+                      << ": Error: " << job.error << "\n";
+            return outcome;
+        }
+
+        outcome.inputBytes = job.file.Data().size();
+        if (job.upToDate)
+        {
+            filesUpToDate.fetch_add(1, std::memory_order_relaxed);
+            outcome.status = FileStatus::UpToDate;
+            return outcome;
+        }
+        if (!job.write)
+        {
+            return outcome;
+        }
+        if (!job.written)
+        {
+            std::cerr << "Error: Could not write to file: " << job.output << "\n";
+            return outcome;
+        }
+
+        outcome.outputBytes = shell.Prefix().size() + job.html.size() + shell.Suffix().size();
+        if (measure)
+        {
+            job.metrics.name = job.input;
+            job.metrics.inputBytes = outcome.inputBytes;
+            job.metrics.outputBytes = outcome.outputBytes;
+            metrics->Add(std::move(job.metrics));
+        }
+
+        if (cache != nullptr)
+        {
+            cache->Record(job.output, job.key);
+        }
+
+        filesProcessed.fetch_add(1, std::memory_order_relaxed);
+        bytesProcessed.fetch_add(outcome.inputBytes, std::memory_order_relaxed);
+        outcome.status = FileStatus::Rendered;
+        return outcome;
+    }
+
+    // Renders with bounded memory, writing HTML while the input is still
+    // being read. "-" reads stdin and writes stdout.
+    FileOutcome StreamFile(const std::string &filename, const std::string &outputfile)
+    {
+        FileOutcome outcome;
+        bool standardStreams = filename == "-";
+        std::optional<StageClock> totalClock;
+        if (metrics != nullptr && metrics->Enabled())
+        {
+            totalClock.emplace();
+        }
+
+        int fd = standardStreams ? STDIN_FILENO : ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            std::cerr << "Thread " << std::this_thread::get_id()
+                      << ": Error: Could not open file: " << filename << "\n";
+            return outcome;
+        }
+
+        std::FILE *outFile = standardStreams ? stdout : std::fopen(outputfile.c_str(), "wb");
+        if (outFile == nullptr)
+        {
+            std::cerr << "Error: Could not write to file: " << outputfile << "\n";
+            ::close(fd);
+            return outcome;
+        }
+        // Streaming never sees the whole input, so there is no key to
+        // record; the old entry no longer describes the output.
+        if (cache != nullptr && !standardStreams)
+        {
+            cache->Forget(outputfile);
+        }
+
+        log << ": Streaming file: " << (standardStreams ? "<stdin>" : std::filesystem::path(filename).filename().string()) << "\n";
+
+        uint64_t bytesRead = 0;
+        uint64_t bytesWritten = 0;
+        std::string error;
+        bool ok;
+        bool written;
+        {
+            FileSink output(outFile);
+            output << shell.Prefix();
+            ok = StreamRenderer().Render(fd, output, error, &bytesRead);
+            output << shell.Suffix();
+            output.Flush();
+            written = !output.Failed();
+            bytesWritten = output.Written();
+        }
+
+        if (!standardStreams)
+        {
+            // A full disk may only show when the last buffer goes out.
+            written = std::fclose(outFile) == 0 && written;
+            ::close(fd);
+        }
+
+        if (!ok)
+        {
+            std::cerr << "Thread " << std::this_thread::get_id()
+                      << ": Error: Could not read " << filename << ": " << error << "\n";
+            return outcome;
+        }
+        if (!written)
+        {
+            std::cerr << "Error: Could not write to file: " << (standardStreams ? "<stdout>" : outputfile) << "\n";
+            return outcome;
+        }
+
+        if (totalClock)
+        {
+            FileMetrics fileMetrics;
+            fileMetrics.name = filename;
+            fileMetrics.streamed = true;
+            fileMetrics.inputBytes = bytesRead;
+            fileMetrics.outputBytes = bytesWritten;
+            fileMetrics.total = totalClock->Elapsed();
+            metrics->Add(std::move(fileMetrics));
+        }
+
+        filesProcessed.fetch_add(1, std::memory_order_relaxed);
+        bytesProcessed.fetch_add(bytesRead, std::memory_order_relaxed);
+        outcome.status = FileStatus::Rendered;
+        outcome.inputBytes = bytesRead;
+        outcome.outputBytes = bytesWritten;
+        return outcome;
+    }
+
+    // Lists one directory of the input tree. Its markdown files are queued
+    // for rendering once the directory is listed and subdirectories become
+    // tasks of their own, so rendering starts long before the walk is done.
+    // Hidden entries and symlinked directories are skipped. When n.md and
+    // n.mdx both map to n.html, the first name in byte order is rendered and
+    // the other is reported as skipped, as is any tree file whose output a
+    // file from the command line already writes.
+    void WalkDirectory(const std::filesystem::path &relative)
+    {
+        const std::filesystem::path inputRoot(options.inputDir);
+        const std::filesystem::path outputRoot(options.outputDir.empty() ? options.inputDir : options.outputDir);
+
+        std::error_code ec;
+        std::vector<std::filesystem::path> sources;
+        std::filesystem::directory_iterator it(inputRoot / relative, ec);
+        for (const std::filesystem::directory_iterator end; !ec && it != end; it.increment(ec))
+        {
+            const std::filesystem::directory_entry &entry = *it;
+            std::filesystem::path name = entry.path().filename();
+            if (name.native()[0] == '.')
+            {
+                continue;
+            }
+
+            std::error_code typeError;
+            bool symlink = entry.is_symlink(typeError);
+            if (!symlink && entry.is_directory(typeError))
+            {
+                pool->Submit([this, child = relative / name] { WalkDirectory(child); });
+                continue;
+            }
+
+            std::filesystem::path extension = name.extension();
+            if ((extension != ".md" && extension != ".mdx") || !entry.is_regular_file(typeError))
+            {
+                continue;
+            }
+
+            sources.push_back(name);
+        }
+
+        if (ec)
+        {
+            std::cerr << "Error: Could not list " << (inputRoot / relative).string() << ": " << ec.message() << "\n";
+            filesFailed.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (sources.empty())
+        {
+            return;
+        }
 
-        Lexer lexer;
-        std::vector<Token> tokens = lexer.Tokenize(fileContent.content);
+        std::error_code mkdirError;
+        std::filesystem::create_directories(outputRoot / relative, mkdirError);
 
-        Parser parser;
-        std::string html = parser.Parse(tokens);
+        std::sort(sources.begin(), sources.end());
+        for (const std::filesystem::path &name : sources)
+        {
+            std::filesystem::path file = relative / name;
+            std::filesystem::path output = file;
+            output.replace_extension(".html");
+            auto record = [this, file, output](const FileOutcome &outcome) {
+                if (!options.manifestPath.empty())
+                {
+                    std::lock_guard<std::mutex> lock(manifestMutex);
+                    manifest.push_back({file.generic_string(), output.generic_string(), outcome});
+                }
+            };
+            Add((inputRoot / file).string(), (outputRoot / output).string(), record);
+        }
+    }
 
-        std::string output = "<!DOCTYPE html>\n";
-        output += "<html>\n<head>\n";
-        output += "<meta charset=\"UTF-8\">\n";
-        output += "<title>Markdown Output</title>\n";
-        output += "<style>\n" + css() + "\n</style>\n";
-        output += "</head>\n<body>\n";
-        output += html;
-        output += "</body>\n</html>\n";
+    // One JSON object per produced file, sorted by input path so that runs
+    // over the same tree can be diffed.
+    bool WriteManifest()
+    {
+        std::sort(manifest.begin(), manifest.end(),
+                  [](const ManifestEntry &a, const ManifestEntry &b) { return a.input < b.input; });
 
-        std::string outputfile = "target/result";
-        outputfile += std::to_string(++i);
-        outputfile += ".html";
+        const char *statusNames[] = {"rendered", "up-to-date", "failed", "skipped"};
+        std::string json = "[\n";
+        for (size_t i = 0; i < manifest.size(); ++i)
+        {
+            const ManifestEntry &entry = manifest[i];
+            json += "  {\"input\": ";
+            AppendJsonString(json, entry.input);
+            json += ", \"output\": ";
+            AppendJsonString(json, entry.output);
+            json += ", \"status\": \"";
+            json += statusNames[static_cast<int>(entry.outcome.status)];
+            json += "\", \"input_bytes\": " + std::to_string(entry.outcome.inputBytes);
+            json += ", \"output_bytes\": " + std::to_string(entry.outcome.outputBytes) + "}";
+            json += i + 1 < manifest.size() ? ",\n" : "\n";
+        }
+        json += "]\n";
 
-        writeToFile(outputfile, output);
+        std::ofstream out(options.manifestPath, std::ios::binary);
+        out << json;
+        return static_cast<bool>(out.flush());
     }
+
+    bool UsesIoRing() const { return pipeline != nullptr && pipeline->UsesIoRing(); }
+
+    size_t FilesProcessed() const { return filesProcessed.load(); }
+    size_t FilesUpToDate() const { return filesUpToDate.load(); }
+    // Directories that could not be listed count as failed files.
+    size_t FilesFailed() const { return filesFailed.load(); }
+    size_t FilesSkipped() const { return filesSkipped.load(); }
+    uint64_t BytesProcessed() const { return bytesProcessed.load(); }
 };
 
+static void printUsage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options] <markdown_file1> [markdown_file2] ...\n";
+    std::cerr << "  -j, --jobs N   worker threads (default: usable cores)\n";
+    std::cerr << "  --stream       render with bounded memory, writing output while reading\n";
+    std::cerr << "  --io MODE      auto (default): batch file I/O through io_uring where the\n"
+                 "                 build and kernel allow it; blocking: plain system calls\n";
+    std::cerr << "  --max-in-flight MB  cap on input and output held between reading and\n"
+                 "                 writing files (default: 256)\n";
+    std::cerr << "  --shell MODE   inline (default), link or fragment: how the stylesheet is\n"
+                 "                 included, or body HTML only\n";
+    std::cerr << "  --css PATH     stylesheet to inline or link (default: utils/formatting.css)\n";
+    std::cerr << "  --template P   HTML template with {{head}} and {{body}} placeholders\n";
+    std::cerr << "  --out-dir DIR  write DIR/<name>.html instead of next to each input\n";
+    std::cerr << "  --input-dir DIR  render every .md/.mdx under DIR, mirroring the tree into\n"
+                 "                 --out-dir (default: next to each input)\n";
+    std::cerr << "  --manifest P   with --input-dir, write a JSON list of the files produced\n"
+                 "                 (default: <out-dir>/manifest.json)\n";
+    std::cerr << "  --cache DIR    skip inputs whose output is unchanged since the last run\n";
+    std::cerr << "  --metrics FMT  per-file stage timings: json (one line per file) or summary\n";
+    std::cerr << "  --metrics-out PATH  where metrics go (default: stderr)\n";
+    std::cerr << "  --rule-stats   per-rule calls, hits, scanned bytes and time (MARKDOWN_RULE_STATS builds)\n";
+    std::cerr << "  --serve        render framed requests from stdin to stdout until EOF or SIGTERM\n";
+    std::cerr << "  --socket PATH  serve framed requests on a Unix socket until SIGINT or SIGTERM\n";
+    std::cerr << "  -              read markdown from stdin and write HTML to stdout\n";
+    std::cerr << "Example: " << program << " document.md\n";
+}
+
+static RenderServer *activeServer = nullptr;
+
+static void stopServer(int)
+{
+    if (activeServer != nullptr)
+    {
+        activeServer->Stop();
+    }
+}
+
+// Daemon mode: the pool and the shell stay warm across requests, and
+// nothing touches the file system. SIGINT and SIGTERM stop reading new
+// requests; the ones already read are answered before the process exits.
+static int serve(const EngineOptions &options, const DocumentShell &shell, WorkerPool &pool, MetricsCollector &metrics)
+{
+    RenderServer server(shell, pool, &metrics);
+    activeServer = &server;
+
+    struct sigaction action{};
+    action.sa_handler = stopServer;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+    // A client that disconnects early must not kill the server.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::cerr << "Markdown Parser - Serving on " << (options.socketPath.empty() ? "stdin/stdout" : options.socketPath)
+              << " with " << pool.size() << " worker(s)\n";
+
+    auto start = std::chrono::steady_clock::now();
+    std::string error;
+    bool ok = options.socketPath.empty() ? server.ServeStream(STDIN_FILENO, STDOUT_FILENO, error)
+                                         : server.ServeSocket(options.socketPath, error);
+    activeServer = nullptr;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!ok)
+    {
+        std::cerr << "Error: " << error << "\n";
+    }
+    std::cerr << "Served " << server.Requests() << " request(s), " << std::fixed << std::setprecision(2)
+              << static_cast<double>(server.BytesIn()) / (1024.0 * 1024.0) << " MB in " << std::setprecision(3)
+              << seconds << " s\n";
+
+    metrics.Finish(seconds);
+    if (options.ruleStats)
+    {
+        RuleStats::Report(std::cerr);
+    }
+    return ok ? 0 : 1;
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc < 2)
+    EngineOptions options;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "-j" || arg == "--jobs" || arg.rfind("--jobs=", 0) == 0)
+        {
+            std::string value;
+            if (arg.rfind("--jobs=", 0) == 0)
+            {
+                value = arg.substr(7);
+            }
+            else if (i + 1 < argc)
+            {
+                value = argv[++i];
+            }
+
+            char *end = nullptr;
+            unsigned long parsed = std::strtoul(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0' || parsed == 0)
+            {
+                std::cerr << "Error: --jobs expects a positive number\n";
+                return 1;
+            }
+            options.jobs = parsed;
+        }
+        else if (arg == "--max-in-flight" && i + 1 < argc)
+        {
+            std::string value = argv[++i];
+            char *end = nullptr;
+            unsigned long long parsed = std::strtoull(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0' || parsed == 0 || parsed > (UINT64_MAX >> 20))
+            {
+                std::cerr << "Error: --max-in-flight expects a positive number of MB\n";
+                return 1;
+            }
+            options.maxInFlightBytes = parsed << 20;
+        }
+        else if (arg == "--stream")
+        {
+            options.stream = true;
+        }
+        else if (arg == "--io" && i + 1 < argc)
+        {
+            std::string value = argv[++i];
+            if (value != "auto" && value != "blocking")
+            {
+                std::cerr << "Error: --io expects auto or blocking\n";
+                return 1;
+            }
+            options.ioRing = value == "auto";
+        }
+        else if (arg == "--serve")
+        {
+            options.serve = true;
+        }
+        else if (arg == "--rule-stats")
+        {
+#ifdef MARKDOWN_RULE_STATS
+            options.ruleStats = true;
+#else
+            std::cerr << "Error: --rule-stats needs a build configured with -DMARKDOWN_RULE_STATS=ON\n";
+            return 1;
+#endif
+        }
+        else if ((arg == "--shell" || arg == "--css" || arg == "--template" ||
+                  arg == "--out-dir" || arg == "--cache" || arg == "--metrics" || arg == "--metrics-out" ||
+                  arg == "--socket" || arg == "--input-dir" || arg == "--output-dir" || arg == "--manifest") &&
+                 i + 1 < argc)
+        {
+            std::string value = argv[++i];
+            if (arg == "--metrics")
+            {
+                if (value == "json")
+                {
+                    options.metrics = MetricsFormat::JsonLines;
+                }
+                else if (value == "summary")
+                {
+                    options.metrics = MetricsFormat::Summary;
+                }
+                else
+                {
+                    std::cerr << "Error: --metrics expects json or summary\n";
+                    return 1;
+                }
+            }
+            else if (arg == "--socket")
+            {
+                options.serve = true;
+                options.socketPath = value;
+            }
+            else if (arg == "--metrics-out")
+            {
+                options.metricsPath = value;
+            }
+            else if (arg == "--input-dir")
+            {
+                options.inputDir = value;
+            }
+            else if (arg == "--manifest")
+            {
+                options.manifestPath = value;
+            }
+            else if (arg == "--out-dir" || arg == "--output-dir")
+            {
+                options.outputDir = value;
+            }
+            else if (arg == "--cache")
+            {
+                options.cacheDir = value;
+            }
+            else if (arg == "--css")
+            {
+                options.stylesheet = value;
+            }
+            else if (arg == "--template")
+            {
+                options.templatePath = value;
+            }
+            else if (value == "inline")
+            {
+                options.shellMode = ShellMode::InlineStyle;
+            }
+            else if (value == "link")
+            {
+                options.shellMode = ShellMode::LinkedStyle;
+            }
+            else if (value == "fragment")
+            {
+                options.shellMode = ShellMode::Fragment;
+            }
+            else
+            {
+                std::cerr << "Error: --shell expects inline, link or fragment\n";
+                return 1;
+            }
+        }
+        else
+        {
+            files.push_back(arg);
+        }
+    }
+
+    bool batch = !files.empty() || !options.inputDir.empty();
+    if (batch == options.serve)
     {
-        std::cerr << "Usage: " << argv[0] << " <markdown_file1> [markdown_file2] ...\n";
-        std::cerr << "Example: " << argv[0] << " document.md\n";
+        printUsage(argv[0]);
         return 1;
     }
 
-    std::cout << "Markdown Parser - Processing " << (argc - 1) << " file(s)\n";
-    std::cout << "Main thread: " << std::this_thread::get_id() << "\n\n";
+    if (!options.inputDir.empty())
+    {
+        if (!std::filesystem::is_directory(options.inputDir))
+        {
+            std::cerr << "Error: Not a directory: " << options.inputDir << "\n";
+            return 1;
+        }
+        if (options.manifestPath.empty())
+        {
+            std::filesystem::path root(options.outputDir.empty() ? options.inputDir : options.outputDir);
+            options.manifestPath = (root / "manifest.json").string();
+        }
+    }
 
-    auto shareManager = std::make_shared<Manager>();
-    std::vector<std::thread> threads;
+    // Largest files first, so a big document is not the straggler at the end.
+    std::vector<std::pair<uintmax_t, std::string>> schedule;
+    for (const auto &file : files)
+    {
+        std::error_code ec;
+        uintmax_t size = std::filesystem::file_size(file, ec);
+        schedule.emplace_back(ec ? 0 : size, file);
+    }
+    std::stable_sort(schedule.begin(), schedule.end(),
+                     [](const auto &a, const auto &b) { return a.first > b.first; });
 
-    for (int i = 1; i < argc; ++i)
+    DocumentShell shell;
+    std::string shellError;
+    if (!shell.Load(options.shellMode, options.stylesheet, options.templatePath, shellError))
+    {
+        std::cerr << "Error: " << shellError << "\n";
+        return 1;
+    }
+
+    if (!options.outputDir.empty())
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(options.outputDir, ec);
+    }
+
+    // Everything besides the input that changes the output: engine version,
+    // output version and rule set of this build, and the shell.
+    uint64_t configHash = Hash64(MARKDOWN_ENGINE_VERSION);
+    configHash = Hash64(Renderer::Fingerprint(), configHash);
+    configHash = Hash64(shell.Suffix(), Hash64(shell.Prefix(), configHash));
+    std::unique_ptr<BuildCache> cache;
+    if (!options.cacheDir.empty())
     {
-        threads.emplace_back(&Manager::ProcessFile, shareManager, argv[i]);
+        cache = std::make_unique<BuildCache>(options.cacheDir, configHash);
+        std::string cacheError;
+        if (!cache->Open(cacheError))
+        {
+            std::cerr << "Error: " << cacheError << "\n";
+            return 1;
+        }
     }
 
-    for (auto &thread : threads)
+    WorkerPool pool(options.jobs);
+
+    std::ofstream metricsFile;
+    if (!options.metricsPath.empty())
     {
-        thread.join();
+        metricsFile.open(options.metricsPath);
+        if (!metricsFile)
+        {
+            std::cerr << "Error: Could not write to file: " << options.metricsPath << "\n";
+            return 1;
+        }
     }
+    MetricsCollector metrics(options.metrics, metricsFile.is_open() ? static_cast<std::ostream &>(metricsFile) : std::cerr);
+
+    if (options.serve)
+    {
+        return serve(options, shell, pool, metrics);
+    }
+
+    // HTML goes to stdout when reading stdin, so progress goes to stderr.
+    std::ostream &log = std::find(files.begin(), files.end(), "-") != files.end() ? std::cerr : std::cout;
+
+    Manager manager(options, shell, cache.get(), &pool, log, &metrics);
+    if (!manager.CheckOutputs(files))
+    {
+        return 1;
+    }
+
+    log << "Markdown Parser - Processing " << files.size() << " file(s)"
+        << (options.inputDir.empty() ? "" : " and the tree under " + options.inputDir) << " on "
+              << pool.size() << " worker(s)" << (manager.UsesIoRing() ? " with io_uring" : "") << "\n";
+    log << "Main thread: " << std::this_thread::get_id() << "\n\n";
+    auto start = std::chrono::steady_clock::now();
 
-    std::cout << "\nAll files processed successfully.\n";
+    for (const auto &entry : schedule)
+    {
+        manager.Add(entry.second);
+    }
+    if (!options.inputDir.empty())
+    {
+        pool.Submit([&manager] { manager.WalkDirectory({}); });
+    }
+    manager.Wait();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double megabytes = static_cast<double>(manager.BytesProcessed()) / (1024.0 * 1024.0);
+
+    if (manager.FilesFailed() == 0 && manager.FilesSkipped() == 0)
+    {
+        log << "\nAll files processed successfully.\n";
+    }
+    else
+    {
+        log << "\nFinished with " << manager.FilesFailed() << " failed and " << manager.FilesSkipped()
+            << " skipped file(s).\n";
+    }
+    log << "Processed " << manager.FilesProcessed() << " file(s), "
+        << manager.FilesUpToDate() << " up to date, " << manager.FilesFailed() << " failed, "
+        << manager.FilesSkipped() << " skipped, "
+              << std::fixed << std::setprecision(2) << megabytes << " MB in "
+              << std::setprecision(3) << seconds << " s ("
+              << std::setprecision(1) << manager.FilesProcessed() / std::max(seconds, 1e-9) << " files/s, "
+              << megabytes / std::max(seconds, 1e-9) << " MB/s)\n";
+
+    metrics.Finish(seconds);
+
+    if (options.ruleStats)
+    {
+        RuleStats::Report(std::cerr);
+    }
+
+    if (!options.inputDir.empty() && !manager.WriteManifest())
+    {
+        std::cerr << "Error: Could not write to file: " << options.manifestPath << "\n";
+        return 1;
+    }
 
-    return 0;
-}
\ No newline at end of file
+    return manager.FilesFailed() == 0 ? 0 : 1;
+}
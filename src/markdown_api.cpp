@@ -0,0 +1,157 @@
+#include "markdown.h"
+#include "output_sink.h"
+#include "renderer.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#ifndef MARKDOWN_ENGINE_VERSION
+#define MARKDOWN_ENGINE_VERSION "dev"
+#endif
+
+namespace {
+
+// Appends to a string owned by someone else, so its capacity is kept
+// between renders.
+class StringSink : public OutputSink {
+public:
+    explicit StringSink(std::string& buffer) : buffer(buffer) {}
+
+    void Write(std::string_view data) override { buffer.append(data); }
+
+private:
+    std::string& buffer;
+};
+
+// Copies into a fixed buffer while it fits and only counts the rest.
+class SpanSink : public OutputSink {
+public:
+    SpanSink(char* out, size_t capacity) : out(out), capacity(capacity) {}
+
+    void Write(std::string_view data) override {
+        if (size < capacity) {
+            size_t fits = std::min(data.size(), capacity - size);
+            std::memcpy(out + size, data.data(), fits);
+        }
+        size += data.size();
+    }
+
+    size_t Size() const { return size; }
+
+private:
+    char* out;
+    size_t capacity;
+    size_t size = 0;
+};
+
+// The C interface must not let exceptions escape.
+template <typename Render>
+markdown_status Guarded(Render render) {
+    try {
+        render();
+        return MARKDOWN_OK;
+    } catch (const std::length_error&) {
+        return MARKDOWN_TOO_LARGE;
+    } catch (const std::bad_alloc&) {
+        return MARKDOWN_OUT_OF_MEMORY;
+    } catch (...) {
+        return MARKDOWN_INTERNAL_ERROR;
+    }
+}
+
+} // namespace
+
+struct markdown_context {
+    std::unique_ptr<WorkerPool> pool;
+    std::string html;
+};
+
+extern "C" {
+
+const char* markdown_version(void) {
+    return MARKDOWN_ENGINE_VERSION;
+}
+
+const char* markdown_status_string(markdown_status status) {
+    switch (status) {
+    case MARKDOWN_OK:
+        return "ok";
+    case MARKDOWN_INVALID_ARGUMENT:
+        return "invalid argument";
+    case MARKDOWN_BUFFER_TOO_SMALL:
+        return "output buffer too small";
+    case MARKDOWN_TOO_LARGE:
+        return "input exceeds 4 GiB";
+    case MARKDOWN_OUT_OF_MEMORY:
+        return "out of memory";
+    case MARKDOWN_INTERNAL_ERROR:
+        return "internal error";
+    }
+    return "unknown status";
+}
+
+markdown_context* markdown_context_new(unsigned threads) {
+    markdown_context* context = new (std::nothrow) markdown_context();
+    if (context == nullptr) {
+        return nullptr;
+    }
+    if (threads > 1) {
+        try {
+            context->pool = std::make_unique<WorkerPool>(threads);
+        } catch (...) {
+            delete context;
+            return nullptr;
+        }
+    }
+    return context;
+}
+
+void markdown_context_free(markdown_context* context) {
+    delete context;
+}
+
+markdown_status markdown_render(markdown_context* context, const char* input, size_t length, const char** html,
+                                size_t* html_length) {
+    if (context == nullptr || (input == nullptr && length != 0) || html == nullptr || html_length == nullptr) {
+        return MARKDOWN_INVALID_ARGUMENT;
+    }
+
+    context->html.clear();
+    markdown_status status = Guarded([&] {
+        context->html.reserve(Renderer::EstimateSize(length));
+        StringSink sink(context->html);
+        Renderer(context->pool.get()).Render(std::string_view(input, length), sink);
+    });
+    if (status != MARKDOWN_OK) {
+        context->html.clear();
+    }
+
+    *html = context->html.c_str();
+    *html_length = context->html.size();
+    return status;
+}
+
+markdown_status markdown_render_into(markdown_context* context, const char* input, size_t length, char* out,
+                                     size_t capacity, size_t* written) {
+    if (context == nullptr || (input == nullptr && length != 0) || (out == nullptr && capacity != 0) ||
+        written == nullptr) {
+        return MARKDOWN_INVALID_ARGUMENT;
+    }
+
+    SpanSink sink(out, capacity);
+    markdown_status status = Guarded([&] {
+        Renderer(context->pool.get()).Render(std::string_view(input, length), sink);
+    });
+
+    *written = status == MARKDOWN_OK ? sink.Size() : 0;
+    if (status == MARKDOWN_OK && sink.Size() > capacity) {
+        return MARKDOWN_BUFFER_TOO_SMALL;
+    }
+    return status;
+}
+
+} // extern "C"
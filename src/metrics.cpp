@@ -0,0 +1,163 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <ctime>
+#include <string_view>
+
+static uint64_t ReadClock(clockid_t clock) {
+    timespec now;
+    clock_gettime(clock, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+}
+
+const char* StageName(Stage stage) {
+    static const char* const names[kStageCount] = {"read", "tokenize", "parse", "write"};
+    return names[static_cast<size_t>(stage)];
+}
+
+StageClock::StageClock()
+    : wallStart(ReadClock(CLOCK_MONOTONIC)), cpuStart(ReadClock(CLOCK_THREAD_CPUTIME_ID)) {}
+
+StageTime StageClock::Elapsed() const {
+    StageTime elapsed;
+    elapsed.wallNs = ReadClock(CLOCK_MONOTONIC) - wallStart;
+    elapsed.cpuNs = ReadClock(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+    return elapsed;
+}
+
+static double BytesPerSecond(uint64_t bytes, uint64_t ns) {
+    return ns == 0 ? 0.0 : static_cast<double>(bytes) * 1e9 / static_cast<double>(ns);
+}
+
+void AppendJsonString(std::string& out, std::string_view text) {
+    out += '"';
+    for (char c : text) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                out += escaped;
+            } else {
+                out += c;
+            }
+        }
+    }
+    out += '"';
+}
+
+static void AppendStage(std::string& out, const char* name, const StageTime& time) {
+    char field[128];
+    std::snprintf(field, sizeof(field), ", \"%s\": {\"wall_us\": %.1f, \"cpu_us\": %.1f}", name,
+                  time.wallNs / 1e3, time.cpuNs / 1e3);
+    out += field;
+}
+
+static std::string ToJsonLine(const FileMetrics& metrics) {
+    std::string line = "{\"file\": ";
+    AppendJsonString(line, metrics.name);
+
+    char field[192];
+    std::snprintf(field, sizeof(field),
+                  ", \"input_bytes\": %" PRIu64 ", \"output_bytes\": %" PRIu64 ", \"tokens\": %" PRIu64
+                  ", \"streamed\": %s",
+                  metrics.inputBytes, metrics.outputBytes, metrics.tokens, metrics.streamed ? "true" : "false");
+    line += field;
+
+    if (!metrics.streamed) {
+        for (size_t stage = 0; stage < kStageCount; ++stage) {
+            AppendStage(line, StageName(static_cast<Stage>(stage)), metrics.stages[stage]);
+        }
+    }
+    AppendStage(line, "total", metrics.total);
+
+    std::snprintf(field, sizeof(field), ", \"bytes_per_s\": %.0f}\n",
+                  BytesPerSecond(metrics.inputBytes, metrics.total.wallNs));
+    line += field;
+    return line;
+}
+
+void MetricsCollector::Add(FileMetrics metrics) {
+    if (format == MetricsFormat::Off) {
+        return;
+    }
+
+    if (format == MetricsFormat::JsonLines) {
+        std::string line = ToJsonLine(metrics);
+        std::lock_guard<std::mutex> lock(mutex);
+        out << line << std::flush;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    files.push_back(std::move(metrics));
+}
+
+// Nearest-rank percentile of sorted values.
+static double Percentile(const std::vector<double>& sorted, double percent) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = static_cast<size_t>(percent / 100.0 * static_cast<double>(sorted.size()) + 0.999999);
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+void MetricsCollector::Finish(double wallSeconds) {
+    if (format != MetricsFormat::Summary) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    char line[160];
+    auto row = [&](const char* name, std::vector<double> values, double total, double cpu, const char* unit) {
+        std::sort(values.begin(), values.end());
+        std::snprintf(line, sizeof(line), "%-10s %12.3f %12.3f %12.3f %12.1f %12.1f  %s\n", name,
+                      Percentile(values, 50), Percentile(values, 95), Percentile(values, 99), total, cpu, unit);
+        out << line;
+    };
+
+    std::snprintf(line, sizeof(line), "\n%-10s %12s %12s %12s %12s %12s\n", "stage", "p50", "p95", "p99", "total",
+                  "cpu total");
+    out << line;
+
+    StageTime totals[kStageCount];
+    for (size_t stage = 0; stage < kStageCount; ++stage) {
+        std::vector<double> values;
+        for (const FileMetrics& file : files) {
+            if (!file.streamed) {
+                values.push_back(file.stages[stage].wallNs / 1e6);
+                totals[stage] += file.stages[stage];
+            }
+        }
+        row(StageName(static_cast<Stage>(stage)), std::move(values), totals[stage].wallNs / 1e6,
+            totals[stage].cpuNs / 1e6, "ms");
+    }
+
+    StageTime total;
+    uint64_t inputBytes = 0;
+    uint64_t outputBytes = 0;
+    uint64_t tokens = 0;
+    std::vector<double> totalTimes;
+    std::vector<double> throughputs;
+    for (const FileMetrics& file : files) {
+        total += file.total;
+        inputBytes += file.inputBytes;
+        outputBytes += file.outputBytes;
+        tokens += file.tokens;
+        totalTimes.push_back(file.total.wallNs / 1e6);
+        throughputs.push_back(BytesPerSecond(file.inputBytes, file.total.wallNs) / 1e6);
+    }
+    row("total", std::move(totalTimes), total.wallNs / 1e6, total.cpuNs / 1e6, "ms");
+    row("file MB/s", std::move(throughputs), BytesPerSecond(inputBytes, static_cast<uint64_t>(wallSeconds * 1e9)) / 1e6,
+        BytesPerSecond(inputBytes, total.cpuNs) / 1e6, "MB/s (total: run wall, cpu: per cpu second)");
+
+    std::snprintf(line, sizeof(line), "%zu file(s), %" PRIu64 " input bytes, %" PRIu64 " output bytes, %" PRIu64
+                  " tokens\n", files.size(), inputBytes, outputBytes, tokens);
+    out << line;
+}
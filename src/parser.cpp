@@ -1,284 +1,306 @@
 #include "parser.h"
-#include <sstream>
+#include "html_escape.h"
 #include <cctype>
 
-std::string Parser::RenderToken(const Token &token)
+void Parser::RenderToken(const Document &doc, uint32_t index, OutputSink &html)
 {
-    std::ostringstream html;
+    const Node &token = doc[index];
 
     switch (token.type)
     {
     case Type::Heading:
-        html << ParseHeading(token);
+        ParseHeading(doc, index, html);
         break;
 
     case Type::listItem:
-        html << ParseList(token);
+        ParseList(doc, index, html);
         break;
 
     case Type::Text:
-        html << ParseText(token);
+        ParseText(doc, index, html);
         break;
 
     case Type::Bold:
-        html << ParseBold(token);
+        ParseBold(doc, index, html);
         break;
 
     case Type::Italic:
-        html << ParseItalic(token);
+        ParseItalic(doc, index, html);
         break;
 
     case Type::Code:
-        html << ParseCode(token);
+        ParseCode(doc, index, html);
         break;
 
     case Type::Link:
-        html << ParseLink(token);
+        ParseLink(doc, index, html);
         break;
 
     default:
-        html << EscapeHTML(token.value);
+        EscapeHTML(doc.Value(token), html);
         break;
     }
+}
 
-    return html.str();
+size_t Parser::EstimateSize(const Document &doc)
+{
+    // Markup adds roughly a tenth to prose plus a few tags per node.
+    size_t source = doc.Source().size();
+    return source + source / 8 + static_cast<size_t>(doc.size()) * 4;
 }
 
-std::string Parser::Parse(const std::vector<Token> &tokens)
+std::string Parser::Parse(const Document &doc)
 {
-    std::ostringstream html;
-    bool inParagraph = false;
-    bool inList = false;
-    bool isOrderedList = false;
+    BufferSink html(EstimateSize(doc));
+    Parse(doc, html);
+    return html.Take();
+}
 
-    for (size_t i = 0; i < tokens.size(); ++i)
-    {
-        const auto &token = tokens[i];
+void Parser::Parse(const Document &doc, OutputSink &html)
+{
+    ParseState state;
+    Parse(doc, html, state, true);
+}
 
-        // Close list if current token is not a list item
-        if (token.type != Type::listItem && inList)
+void Parser::Parse(const Document &doc, OutputSink &html, ParseState &state, bool last)
+{
+    for (uint32_t i = 0; i < doc.size(); i = doc[i].next)
+    {
+        // More input follows: leave open elements to the next part.
+        if (doc[i].type == Type::EndOfFile && !last)
         {
-            html << (isOrderedList ? "</ol>\n" : "</ul>\n");
-            inList = false;
+            break;
         }
 
-        switch (token.type)
-        {
-        case Type::Heading:
-            if (inParagraph)
-            {
-                html << "</p>\n";
-                inParagraph = false;
-            }
-            html << RenderToken(token);
-            break;
+        ParseBlock(doc, i, html, state);
+    }
+}
 
-        case Type::listItem:
+void Parser::ParseBlock(const Document &doc, uint32_t i, OutputSink &html, ParseState &state)
+{
+    bool &inParagraph = state.inParagraph;
+    bool &inList = state.inList;
+    bool &isOrderedList = state.isOrderedList;
+
+    const Node &token = doc[i];
+
+    bool continuesParagraph = state.continuesParagraph;
+    state.continuesParagraph = false;
+
+    // Close list if current token is not a list item
+    if (token.type != Type::listItem && inList)
+    {
+        html << (isOrderedList ? "</ol>\n" : "</ul>\n");
+        inList = false;
+    }
+
+    switch (token.type)
+    {
+    case Type::Heading:
+        if (inParagraph)
         {
-            bool currentIsOrdered = IsOrderedList(token.meta);
+            html << "</p>\n";
+            inParagraph = false;
+        }
+        RenderToken(doc, i, html);
+        break;
 
-            if (!inList)
-            {
-                html << (currentIsOrdered ? "<ol>\n" : "<ul>\n");
-                inList = true;
-                isOrderedList = currentIsOrdered;
-            }
+    case Type::listItem:
+    {
+        bool currentIsOrdered = IsOrderedList(doc.Meta(token));
 
-            else if (currentIsOrdered != isOrderedList)
-            {
-                html << (isOrderedList ? "</ol>\n" : "</ul>\n");
-                html << (currentIsOrdered ? "<ol>\n" : "<ul>\n");
-                isOrderedList = currentIsOrdered;
-            }
+        if (!inList)
+        {
+            html << (currentIsOrdered ? "<ol>\n" : "<ul>\n");
+            inList = true;
+            isOrderedList = currentIsOrdered;
+        }
 
-            html << RenderToken(token);
-            break;
+        else if (currentIsOrdered != isOrderedList)
+        {
+            html << (isOrderedList ? "</ol>\n" : "</ul>\n");
+            html << (currentIsOrdered ? "<ol>\n" : "<ul>\n");
+            isOrderedList = currentIsOrdered;
         }
 
-        case Type::Text:
-            if (inParagraph)
-            {
-                html << "</p>\n";
-                inParagraph = false;
-            }
-            if (!token.value.empty() && token.value != "\n")
-            {
-                if (!inParagraph)
-                {
-                    html << "<p>";
-                    inParagraph = true;
-                }
-                html << RenderToken(token);
-            }
-            break;
+        RenderToken(doc, i, html);
+        break;
+    }
 
-        case Type::Code:
-            if (inParagraph)
-            {
-                html << "</p>\n";
-                inParagraph = false;
-            }
-            html << RenderToken(token);
+    case Type::Text:
+        if (continuesParagraph && inParagraph)
+        {
+            RenderToken(doc, i, html);
             break;
-
-        case Type::Bold:
+        }
+        if (inParagraph)
+        {
+            html << "</p>\n";
+            inParagraph = false;
+        }
+        if (token.valueLength != 0 && doc.Value(token) != "\n")
+        {
             if (!inParagraph)
             {
                 html << "<p>";
                 inParagraph = true;
             }
-            html << RenderToken(token);
-            break;
+            RenderToken(doc, i, html);
+        }
+        break;
 
-        case Type::Italic:
-            if (!inParagraph)
-            {
-                html << "<p>";
-                inParagraph = true;
-            }
-            html << RenderToken(token);
-            break;
+    case Type::Code:
+        if (inParagraph)
+        {
+            html << "</p>\n";
+            inParagraph = false;
+        }
+        RenderToken(doc, i, html);
+        break;
 
-        case Type::Link:
-            if (!inParagraph)
-            {
-                html << "<p>";
-                inParagraph = true;
-            }
-            html << RenderToken(token);
-            break;
+    case Type::Bold:
+        if (!inParagraph)
+        {
+            html << "<p>";
+            inParagraph = true;
+        }
+        RenderToken(doc, i, html);
+        break;
 
-        case Type::EndOfFile:
-            if (inList)
-            {
-                html << (isOrderedList ? "</ol>\n" : "</ul>\n");
-                inList = false;
-            }
-            if (inParagraph)
-            {
-                html << "</p>\n";
-                inParagraph = false;
-            }
-            break;
+    case Type::Italic:
+        if (!inParagraph)
+        {
+            html << "<p>";
+            inParagraph = true;
+        }
+        RenderToken(doc, i, html);
+        break;
 
-        case Type::HorizontalRule:
-            if (inParagraph)
-            {
-                html << "</p>\n";
-                inParagraph = false;
-            }
-            html << "<hr style= />\n";
-            break;
+    case Type::Link:
+        if (!inParagraph)
+        {
+            html << "<p>";
+            inParagraph = true;
+        }
+        RenderToken(doc, i, html);
+        break;
 
-        default:
-            break;
+    case Type::EndOfFile:
+        if (inList)
+        {
+            html << (isOrderedList ? "</ol>\n" : "</ul>\n");
+            inList = false;
         }
-    }
+        if (inParagraph)
+        {
+            html << "</p>\n";
+            inParagraph = false;
+        }
+        break;
 
-    return html.str();
+    case Type::HorizontalRule:
+        if (inParagraph)
+        {
+            html << "</p>\n";
+            inParagraph = false;
+        }
+        html << "<hr style= />\n";
+        break;
+
+    default:
+        break;
+    }
 }
 
-std::string Parser::ParseHeading(const Token &token)
+void Parser::ParseHeading(const Document &doc, uint32_t index, OutputSink &html)
 {
-    int level = token.meta.length();
-    return "<h" + std::to_string(level) + ">" +
-           EscapeHTML(token.value) +
-           "</h" + std::to_string(level) + ">\n";
+    const Node &token = doc[index];
+    const char level = static_cast<char>('0' + token.metaLength);
+    html << "<h" << std::string_view(&level, 1) << ">";
+    EscapeHTML(doc.Value(token), html);
+    html << "</h" << std::string_view(&level, 1) << ">\n";
 }
 
-std::string Parser::ParseBold(const Token &token)
+void Parser::ParseBold(const Document &doc, uint32_t index, OutputSink &html)
 {
-    return "<strong>" + EscapeHTML(token.value) + "</strong>";
+    html << "<strong>";
+    RenderChildren(doc, index, html);
+    html << "</strong>";
 }
 
-std::string Parser::ParseItalic(const Token &token)
+void Parser::ParseItalic(const Document &doc, uint32_t index, OutputSink &html)
 {
-    return "<em>" + EscapeHTML(token.value) + "</em>";
+    html << "<em>";
+    RenderChildren(doc, index, html);
+    html << "</em>";
 }
 
-std::string Parser::ParseCode(const Token &token)
+void Parser::ParseCode(const Document &doc, uint32_t index, OutputSink &html)
 {
-    std::ostringstream html;
-    if (token.meta.empty())
+    const Node &token = doc[index];
+    if (token.metaLength == 0)
     {
-        html << "<code>" << EscapeHTML(token.value) << "</code>";
+        html << "<code>";
+        EscapeHTML(doc.Value(token), html);
+        html << "</code>";
     }
     else
     {
-        html << "<pre><code class=\"language-" << std::string(token.meta) << "\">"
-             << EscapeHTML(token.value) << "</code></pre>\n";
+        html << "<pre><code class=\"language-" << doc.Meta(token) << "\">";
+        EscapeHTML(doc.Value(token), html);
+        html << "</code></pre>\n";
     }
-    return html.str();
 }
 
-std::string Parser::ParseLink(const Token &token)
+void Parser::ParseLink(const Document &doc, uint32_t index, OutputSink &html)
 {
-    return "<a href=\"" + EscapeHTML(token.meta) + "\">" +
-           EscapeHTML(token.value) + "</a>";
+    const Node &token = doc[index];
+    html << "<a href=\"";
+    EscapeHTML(doc.Meta(token), html);
+    html << "\">";
+    EscapeHTML(doc.Value(token), html);
+    html << "</a>";
 }
 
-std::string Parser::ParseList(const Token &token)
+void Parser::ParseList(const Document &doc, uint32_t index, OutputSink &html)
 {
-    std::ostringstream html;
     html << "<li>";
-    if (!token.children.empty())
-    {
-        for (const auto &child : token.children)
-            html << RenderToken(child);
-    }
-    else
-    {
-        html << EscapeHTML(token.value);
-    }
+    RenderChildren(doc, index, html);
     html << "</li>\n";
-    return html.str();
 }
 
-std::string Parser::ParseText(const Token &token)
+void Parser::ParseText(const Document &doc, uint32_t index, OutputSink &html)
 {
-    std::ostringstream html;
-    if (!token.children.empty())
-    {
-        for (const auto &child : token.children)
-            html << RenderToken(child);
-    }
-    else
-    {
-        html << EscapeHTML(token.value);
-    }
-    return html.str();
+    RenderChildren(doc, index, html);
 }
 
-std::string Parser::EscapeHTML(std::string_view text)
+void Parser::RenderChildren(const Document &doc, uint32_t index, OutputSink &html)
 {
-    std::string result;
-    result.reserve(text.size());
-
-    for (char c : text)
+    if (doc.InlinesDeferred())
     {
-        switch (c)
+        const Document &inlines = doc.Inlines(index);
+        if (inlines.size() == 0)
         {
-        case '<':
-            result += "&lt;";
-            break;
-        case '>':
-            result += "&gt;";
-            break;
-        case '&':
-            result += "&amp;";
-            break;
-        case '"':
-            result += "&quot;";
-            break;
-        case '\'':
-            result += "&#39;";
-            break;
-        default:
-            result += c;
+            EscapeHTML(doc.Value(doc[index]), html);
+            return;
+        }
+        for (uint32_t child = 0; child < inlines.size(); child = inlines[child].next)
+        {
+            RenderToken(inlines, child, html);
         }
+        return;
+    }
+
+    if (!doc.HasChildren(index))
+    {
+        EscapeHTML(doc.Value(doc[index]), html);
+        return;
     }
 
-    return result;
+    for (uint32_t child = doc.FirstChild(index); child < doc.ChildrenEnd(index); child = doc[child].next)
+    {
+        RenderToken(doc, child, html);
+    }
 }
 
 bool Parser::IsOrderedList(std::string_view meta)
@@ -0,0 +1,428 @@
+#include "render_server.h"
+#include "lexer.h"
+#include "output_sink.h"
+#include "renderer.h"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fcntl.h>
+#include <limits.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr size_t kReadChunk = 64 * 1024;
+constexpr size_t kHeaderSize = 8;
+
+uint32_t LoadBigEndian(const char* bytes) {
+    const unsigned char* b = reinterpret_cast<const unsigned char*>(bytes);
+    return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | uint32_t(b[3]);
+}
+
+void StoreBigEndian(unsigned char* bytes, uint32_t value) {
+    bytes[0] = static_cast<unsigned char>(value >> 24);
+    bytes[1] = static_cast<unsigned char>(value >> 16);
+    bytes[2] = static_cast<unsigned char>(value >> 8);
+    bytes[3] = static_cast<unsigned char>(value);
+}
+
+// Writes every byte of parts, retrying partial writes. Modifies parts.
+bool WriteAll(int fd, std::vector<iovec>& parts) {
+    iovec* next = parts.data();
+    size_t count = parts.size();
+
+    while (count > 0) {
+        ssize_t written = ::writev(fd, next, static_cast<int>(std::min<size_t>(count, IOV_MAX)));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        size_t remaining = static_cast<size_t>(written);
+        while (count > 0 && remaining >= next->iov_len) {
+            remaining -= next->iov_len;
+            ++next;
+            --count;
+        }
+        if (count > 0) {
+            next->iov_base = static_cast<char*>(next->iov_base) + remaining;
+            next->iov_len -= remaining;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+// One framed byte stream. The calling thread reads requests and hands
+// them to the pool; a writer thread sends the responses back in order.
+class RenderServer::Connection {
+public:
+    Connection(RenderServer& server, int in, int out)
+        : server(server), in(in), out(out), measure(server.metrics != nullptr && server.metrics->Enabled()),
+          maxInFlight(server.pool.size() * 4 + 4) {}
+
+    bool Run(std::string& error) {
+        std::thread writer([this] { WriteLoop(); });
+        bool ok = ReadLoop(error);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished = true;
+        changed.notify_all();
+        lock.unlock();
+        writer.join();
+
+        if (ok && !writeError.empty()) {
+            error = writeError;
+            ok = false;
+        }
+        return ok;
+    }
+
+private:
+    struct Request {
+        uint64_t index = 0;
+        std::string input;
+        size_t inputBytes = 0;
+        std::string html;
+        ServeStatus status = ServeStatus::Ok;
+        unsigned char header[kHeaderSize];
+        RenderStats stats;
+        StageClock received;
+        bool done = false;
+    };
+
+    bool ReadLoop(std::string& error) {
+        std::string buffer;
+        size_t begin = 0;
+
+        while (true) {
+            // Every complete frame in the buffer becomes a request.
+            while (buffer.size() - begin >= 4) {
+                uint32_t length = LoadBigEndian(buffer.data() + begin);
+                if (length > server.maxRequest) {
+                    auto request = std::make_unique<Request>();
+                    request->status = ServeStatus::TooLarge;
+                    request->html = "request of " + std::to_string(length) + " bytes exceeds the limit of " +
+                                     std::to_string(server.maxRequest);
+                    request->done = true;
+                    Enqueue(std::move(request), false);
+                    return true;
+                }
+                if (buffer.size() - begin - 4 < length) {
+                    buffer.reserve(begin + 4 + length);
+                    break;
+                }
+
+                auto request = std::make_unique<Request>();
+                request->input.assign(buffer, begin + 4, length);
+                request->inputBytes = length;
+                begin += 4 + length;
+                server.requests.fetch_add(1, std::memory_order_relaxed);
+                server.bytesIn.fetch_add(length, std::memory_order_relaxed);
+                if (!Enqueue(std::move(request), true)) {
+                    return true;
+                }
+            }
+
+            buffer.erase(0, begin);
+            begin = 0;
+
+            if (!server.WaitReadable(in)) {
+                return true;
+            }
+
+            size_t used = buffer.size();
+            buffer.resize(used + std::max(kReadChunk, buffer.capacity() - used));
+            ssize_t received = ::read(in, &buffer[used], buffer.size() - used);
+            buffer.resize(used + static_cast<size_t>(std::max<ssize_t>(received, 0)));
+            if (received == 0) {
+                return true;
+            }
+            if (received < 0 && errno != EINTR && errno != EAGAIN) {
+                error = std::string("read failed: ") + std::strerror(errno);
+                return false;
+            }
+        }
+    }
+
+    // Queues a request behind the ones already read, waiting while too many
+    // are in flight. False once the output is gone and reading should stop.
+    bool Enqueue(std::unique_ptr<Request> request, bool render) {
+        Request* raw = request.get();
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this] { return queue.size() < maxInFlight || broken; });
+            if (broken) {
+                return false;
+            }
+            raw->index = next++;
+            queue.push_back(std::move(request));
+        }
+
+        if (render) {
+            server.pool.Submit([this, raw] { Render(*raw); });
+        }
+        return true;
+    }
+
+    void Render(Request& request) {
+        try {
+            BufferSink sink(Renderer::EstimateSize(request.input.size()));
+            Renderer(&server.pool).Render(request.input, sink, measure ? &request.stats : nullptr);
+            request.html = sink.Take();
+        } catch (const std::exception& e) {
+            request.status = ServeStatus::Failed;
+            request.html = e.what();
+        }
+        std::string().swap(request.input);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        request.done = true;
+        changed.notify_all();
+    }
+
+    // Sends finished responses in request order. Whatever is ready at the
+    // front of the queue goes out in a single write.
+    void WriteLoop() {
+        std::vector<std::unique_ptr<Request>> batch;
+        std::vector<iovec> parts;
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true) {
+            changed.wait(lock, [this] { return (!queue.empty() && queue.front()->done) || (finished && queue.empty()); });
+            if (queue.empty()) {
+                return;
+            }
+
+            batch.clear();
+            while (!queue.empty() && queue.front()->done) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+            changed.notify_all();
+            bool discard = broken;
+            lock.unlock();
+
+            std::optional<StageClock> writeClock;
+            if (measure) {
+                writeClock.emplace();
+            }
+
+            bool ok = discard || Write(batch, parts);
+            int writeErrno = errno;
+
+            if (measure && !discard) {
+                Record(batch, writeClock->Elapsed());
+            }
+
+            lock.lock();
+            if (!ok && !broken) {
+                broken = true;
+                writeError = std::string("write failed: ") + std::strerror(writeErrno);
+                changed.notify_all();
+            }
+        }
+    }
+
+    bool Write(std::vector<std::unique_ptr<Request>>& requests, std::vector<iovec>& parts) {
+        const DocumentShell& shell = server.shell;
+        parts.clear();
+
+        auto add = [&parts](const void* data, size_t size) {
+            if (size != 0) {
+                parts.push_back(iovec{const_cast<void*>(data), size});
+            }
+        };
+
+        for (const std::unique_ptr<Request>& request : requests) {
+            bool wrap = request->status == ServeStatus::Ok;
+            size_t length = request->html.size() + (wrap ? shell.Prefix().size() + shell.Suffix().size() : 0);
+            StoreBigEndian(request->header, static_cast<uint32_t>(request->status));
+            StoreBigEndian(request->header + 4, static_cast<uint32_t>(length));
+
+            add(request->header, kHeaderSize);
+            if (wrap) {
+                add(shell.Prefix().data(), shell.Prefix().size());
+            }
+            add(request->html.data(), request->html.size());
+            if (wrap) {
+                add(shell.Suffix().data(), shell.Suffix().size());
+            }
+        }
+        return WriteAll(out, parts);
+    }
+
+    // Latency is measured from the moment a request was read to the end of
+    // the write that carried its response.
+    void Record(const std::vector<std::unique_ptr<Request>>& requests, const StageTime& write) {
+        for (const std::unique_ptr<Request>& request : requests) {
+            FileMetrics metrics;
+            metrics.name = "request " + std::to_string(request->index);
+            metrics.inputBytes = request->inputBytes;
+            metrics.outputBytes = request->html.size();
+            metrics.tokens = request->stats.tokens;
+            metrics[Stage::Tokenize] = request->stats.tokenize;
+            metrics[Stage::Parse] = request->stats.parse;
+            metrics[Stage::Write] = write;
+            metrics.total.wallNs = request->received.Elapsed().wallNs;
+            metrics.total.cpuNs = request->stats.tokenize.cpuNs + request->stats.parse.cpuNs + write.cpuNs;
+            server.metrics->Add(std::move(metrics));
+        }
+    }
+
+    RenderServer& server;
+    int in;
+    int out;
+    bool measure;
+    size_t maxInFlight;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::unique_ptr<Request>> queue;
+    uint64_t next = 0;
+    // The reader is done; the writer drains the queue and returns.
+    bool finished = false;
+    // A write failed; responses are dropped and reading stops.
+    bool broken = false;
+    std::string writeError;
+};
+
+RenderServer::RenderServer(const DocumentShell& shell, WorkerPool& pool, MetricsCollector* metrics,
+                           uint32_t maxRequest)
+    : shell(shell), pool(pool), metrics(metrics), maxRequest(maxRequest) {
+    if (::pipe2(wake, O_CLOEXEC | O_NONBLOCK) != 0) {
+        wake[0] = wake[1] = -1;
+    }
+}
+
+RenderServer::~RenderServer() {
+    for (int fd : wake) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+void RenderServer::Stop() {
+    stopping.store(true);
+    if (wake[1] >= 0) {
+        char byte = 0;
+        ssize_t ignored = ::write(wake[1], &byte, 1);
+        (void)ignored;
+    }
+}
+
+bool RenderServer::WaitReadable(int fd) {
+    while (!stopping.load()) {
+        pollfd fds[2] = {{fd, POLLIN, 0}, {wake[0], POLLIN, 0}};
+        int ready = ::poll(fds, 2, -1);
+        if (ready < 0 && errno != EINTR) {
+            return false;
+        }
+        if (ready > 0 && fds[0].revents != 0) {
+            return !stopping.load();
+        }
+    }
+    return false;
+}
+
+bool RenderServer::ServeStream(int in, int out, std::string& error) {
+    Connection connection(*this, in, out);
+    return connection.Run(error);
+}
+
+bool RenderServer::ServeSocket(const std::string& path, std::string& error) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        error = "socket path is too long: " + path;
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    const sockaddr* raw = reinterpret_cast<const sockaddr*>(&address);
+
+    // A socket file left behind by a server that died is replaced; one that
+    // still accepts connections is not.
+    int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0) {
+        bool live = ::connect(probe, raw, sizeof(address)) == 0;
+        ::close(probe);
+        if (live) {
+            error = "another server is listening on " + path;
+            return false;
+        }
+        if (errno == ECONNREFUSED) {
+            ::unlink(path.c_str());
+        }
+    }
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || ::bind(listener, raw, sizeof(address)) != 0 || ::listen(listener, SOMAXCONN) != 0) {
+        error = "cannot listen on " + path + ": " + std::strerror(errno);
+        if (listener >= 0) {
+            ::close(listener);
+        }
+        return false;
+    }
+
+    struct Client {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+    std::vector<Client> clients;
+    bool ok = true;
+
+    while (WaitReadable(listener)) {
+        // Join the connection threads that have finished.
+        clients.erase(std::remove_if(clients.begin(), clients.end(),
+                                     [](Client& client) {
+                                         if (!client.done->load()) {
+                                             return false;
+                                         }
+                                         client.thread.join();
+                                         return true;
+                                     }),
+                      clients.end());
+
+        int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == ECONNABORTED) {
+                continue;
+            }
+            error = std::string("accept failed: ") + std::strerror(errno);
+            ok = false;
+            break;
+        }
+
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        clients.push_back(Client{std::thread([this, fd, done] {
+                                     std::string ignored;
+                                     Connection(*this, fd, fd).Run(ignored);
+                                     ::close(fd);
+                                     done->store(true);
+                                 }),
+                                 done});
+    }
+
+    ::close(listener);
+    ::unlink(path.c_str());
+    for (Client& client : clients) {
+        client.thread.join();
+    }
+    return ok;
+}
@@ -0,0 +1,122 @@
+#include "renderer.h"
+#include "lexer.h"
+#include "parser.h"
+#include "heading_rule.h"
+#include "rule_pipeline.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+
+void Renderer::RenderSerial(std::string_view input, OutputSink& out, RenderStats* stats) {
+    if (stats == nullptr) {
+        Lexer lexer;
+        Document doc = lexer.Tokenize(input);
+
+        Parser parser;
+        parser.Parse(doc, out);
+        return;
+    }
+
+    StageClock tokenizeClock;
+    Lexer lexer;
+    Document doc = lexer.Tokenize(input);
+    stats->tokenize += tokenizeClock.Elapsed();
+    stats->tokens += doc.size();
+
+    StageClock parseClock;
+    Parser parser;
+    parser.Parse(doc, out);
+    stats->parse += parseClock.Elapsed();
+}
+
+std::string Renderer::Fingerprint() {
+    const std::pair<const char*, bool> rules[] = {
+        {"heading", MARKDOWN_RULE_HEADING}, {"list", MARKDOWN_RULE_LIST}, {"code", MARKDOWN_RULE_CODE},
+        {"link", MARKDOWN_RULE_LINK},       {"hr", MARKDOWN_RULE_HR},     {"emphasis", MARKDOWN_RULE_EMPHASIS},
+    };
+
+    std::string fingerprint = "output " + std::to_string(kOutputVersion) + ", rules";
+    for (const auto& rule : rules) {
+        if (rule.second) {
+            fingerprint += ' ';
+            fingerprint += rule.first;
+        }
+    }
+    return fingerprint;
+}
+
+// A line that starts a heading is a seam in both stages: the lexer ends the
+// running text block there, and the parser closes any open list and
+// paragraph before the heading, exactly as it does at the end of a chunk.
+// Lists and text runs have no such reset, so no other line is safe to cut.
+std::vector<size_t> Renderer::SplitPoints(std::string_view input, size_t target) {
+    static const HeadingRule headingRule;
+
+    std::vector<size_t> points{0};
+    size_t next = target;
+
+    // Without the heading rule there is no seam, so the input stays whole.
+    while (MARKDOWN_RULE_HEADING && next < input.size()) {
+        const void* found = std::memchr(input.data() + next, '\n', input.size() - next);
+        if (found == nullptr) {
+            break;
+        }
+
+        size_t lineStart = static_cast<size_t>(static_cast<const char*>(found) - input.data()) + 1;
+        if (lineStart >= input.size()) {
+            break;
+        }
+
+        if (input[lineStart] == '#' && headingRule.Match(input, lineStart)) {
+            points.push_back(lineStart);
+            next = lineStart + target;
+        } else {
+            next = lineStart;
+        }
+    }
+
+    points.push_back(input.size());
+    return points;
+}
+
+void Renderer::Render(std::string_view input, OutputSink& out, RenderStats* stats) const {
+    if (pool == nullptr || pool->size() < 2 || input.size() < parallelThreshold) {
+        RenderSerial(input, out, stats);
+        return;
+    }
+
+    // A few chunks per worker keeps the load even when sections differ in size.
+    size_t target = std::max<size_t>(input.size() / (pool->size() * 4), parallelThreshold / 4);
+    std::vector<size_t> points = SplitPoints(input, target);
+    if (points.size() <= 2) {
+        RenderSerial(input, out, stats);
+        return;
+    }
+
+    std::vector<std::string> chunks(points.size() - 1);
+    std::vector<RenderStats> chunkStats(stats != nullptr ? chunks.size() : 0);
+    {
+        TaskGroup group(*pool);
+        for (size_t i = 0; i + 1 < points.size(); ++i) {
+            std::string_view chunk = input.substr(points[i], points[i + 1] - points[i]);
+            RenderStats* chunkStat = stats != nullptr ? &chunkStats[i] : nullptr;
+            group.Submit([chunk, chunkStat, &html = chunks[i]] {
+                BufferSink sink(EstimateSize(chunk.size()));
+                RenderSerial(chunk, sink, chunkStat);
+                html = sink.Take();
+            });
+        }
+        group.Wait();
+    }
+
+    for (const RenderStats& chunkStat : chunkStats) {
+        stats->tokenize += chunkStat.tokenize;
+        stats->parse += chunkStat.parse;
+        stats->tokens += chunkStat.tokens;
+    }
+
+    for (const std::string& html : chunks) {
+        out << html;
+    }
+}
@@ -0,0 +1,101 @@
+#include "rule_stats.h"
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// Tables of live threads, and the sum of tables whose threads have exited.
+struct Registry {
+    std::mutex mutex;
+    std::vector<const RuleTable*> live;
+    RuleTable retired{};
+};
+
+Registry& GetRegistry() {
+    static Registry* registry = new Registry();  // outlives thread_local destructors
+    return *registry;
+}
+
+void Add(RuleTable& total, const RuleTable& table) {
+    for (size_t i = 0; i < kRuleCount; ++i) {
+        total[i].calls += table[i].calls;
+        total[i].hits += table[i].hits;
+        total[i].bytesScanned += table[i].bytesScanned;
+        total[i].bytesConsumed += table[i].bytesConsumed;
+        total[i].ns += table[i].ns;
+    }
+}
+
+struct ThreadTable {
+    RuleTable table{};
+
+    ThreadTable() {
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.live.push_back(&table);
+    }
+
+    ~ThreadTable() {
+        Registry& registry = GetRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        Add(registry.retired, table);
+        for (size_t i = 0; i < registry.live.size(); ++i) {
+            if (registry.live[i] == &table) {
+                registry.live[i] = registry.live.back();
+                registry.live.pop_back();
+                break;
+            }
+        }
+    }
+};
+
+} // namespace
+
+const char* RuleName(RuleId id) {
+    static const char* const names[kRuleCount] = {"heading", "list", "code", "link", "hr", "emphasis"};
+    return names[static_cast<size_t>(id)];
+}
+
+RuleCounters& RuleStats::Local(RuleId id) {
+    thread_local ThreadTable counters;
+    return counters.table[static_cast<size_t>(id)];
+}
+
+uint64_t RuleStats::Now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+RuleTable RuleStats::Collect() {
+    Registry& registry = GetRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+
+    RuleTable total = registry.retired;
+    for (const RuleTable* table : registry.live) {
+        Add(total, *table);
+    }
+    return total;
+}
+
+void RuleStats::Report(std::ostream& out) {
+    RuleTable total = Collect();
+
+    char line[200];
+    std::snprintf(line, sizeof(line), "\n%-8s %12s %12s %7s %14s %14s %10s %8s\n", "rule", "calls", "hits", "hit %",
+                  "bytes scanned", "bytes consumed", "ms", "ns/call");
+    out << line;
+
+    for (size_t i = 0; i < kRuleCount; ++i) {
+        const RuleCounters& rule = total[i];
+        std::snprintf(line, sizeof(line), "%-8s %12llu %12llu %7.1f %14llu %14llu %10.2f %8.1f\n",
+                      RuleName(static_cast<RuleId>(i)), static_cast<unsigned long long>(rule.calls),
+                      static_cast<unsigned long long>(rule.hits),
+                      rule.calls == 0 ? 0.0 : 100.0 * rule.hits / rule.calls,
+                      static_cast<unsigned long long>(rule.bytesScanned),
+                      static_cast<unsigned long long>(rule.bytesConsumed), rule.ns / 1e6,
+                      rule.calls == 0 ? 0.0 : static_cast<double>(rule.ns) / rule.calls);
+        out << line;
+    }
+}
@@ -0,0 +1,91 @@
+#include "stream_renderer.h"
+#include "lexer.h"
+#include "parser.h"
+#include "heading_rule.h"
+#include "list_rule.h"
+#include "rule_pipeline.h"
+#include <cerrno>
+#include <cstring>
+#include <string_view>
+#include <unistd.h>
+
+// True when the complete line starting at lineStart opens a heading or list
+// item, i.e. the lexer starts a new block there whatever precedes it.
+static bool StartsBlock(std::string_view input, size_t lineStart) {
+    static const HeadingRule headingRule;
+    static const ListRule listRule;
+    return (MARKDOWN_RULE_HEADING && headingRule.Match(input, lineStart)) ||
+           (MARKDOWN_RULE_LIST && listRule.Match(input, lineStart));
+}
+
+static void RenderPart(std::string_view part, OutputSink& out, ParseState& state, bool last) {
+    Lexer lexer;
+    Document doc = lexer.Tokenize(part);
+
+    Parser parser;
+    parser.Parse(doc, out, state, last);
+}
+
+bool StreamRenderer::Render(int fd, OutputSink& out, std::string& error, uint64_t* bytesRead) const {
+    std::string buffer;
+    buffer.reserve(chunkSize * 2);
+
+    ParseState state;
+    // Lines starting before `scanned` have been checked; it is always the
+    // start of the first line that is not yet complete.
+    size_t scanned = 0;
+    // Start of the last complete line that opens a block, 0 when none.
+    size_t cut = 0;
+
+    while (true) {
+        size_t used = buffer.size();
+        buffer.resize(used + chunkSize);
+        ssize_t n = ::read(fd, &buffer[used], chunkSize);
+        if (n < 0) {
+            buffer.resize(used);
+            if (errno == EINTR) {
+                continue;
+            }
+            error = std::strerror(errno);
+            return false;
+        }
+        buffer.resize(used + static_cast<size_t>(n));
+        if (bytesRead != nullptr) {
+            *bytesRead += static_cast<uint64_t>(n);
+        }
+
+        if (n == 0) {
+            RenderPart(buffer, out, state, true);
+            out.Flush();
+            return true;
+        }
+
+        std::string_view input(buffer);
+        while (const void* found = std::memchr(input.data() + scanned, '\n', input.size() - scanned)) {
+            if (scanned > 0 && StartsBlock(input, scanned)) {
+                cut = scanned;
+            }
+            scanned = static_cast<size_t>(static_cast<const char*>(found) - input.data()) + 1;
+        }
+
+        bool forced = false;
+        if (cut == 0 && buffer.size() >= maxBlock) {
+            // One block has outgrown the limit: cut it at the last line break,
+            // or mid-line when a single line is that long.
+            cut = scanned > 0 ? scanned : buffer.size();
+            forced = true;
+        }
+
+        if (cut == 0) {
+            continue;
+        }
+
+        RenderPart(input.substr(0, cut), out, state, false);
+        state.continuesParagraph = forced;
+        out.Flush();
+
+        buffer.erase(0, cut);
+        scanned = scanned >= cut ? scanned - cut : 0;
+        cut = 0;
+    }
+}
@@ -0,0 +1,163 @@
+#include "structural_index.h"
+#include "cpu_features.h"
+#include <array>
+#include <cstring>
+
+#ifdef MARKDOWN_X86
+#include <immintrin.h>
+#endif
+
+// Bytes any block or inline rule can start on, plus the link delimiters.
+// Digits that open ordered lists are only relevant at line starts, which
+// the block stage reaches through the newline bitmap.
+static constexpr char kStructuralBytes[] = "\n#*_`[]()-+";
+
+using ScanKernel = void (*)(const char* data, size_t blocks, uint64_t* structural, uint64_t* newlines);
+
+static const std::array<bool, 256>& StructuralTable() {
+    static const std::array<bool, 256> table = [] {
+        std::array<bool, 256> t{};
+        for (const char* c = kStructuralBytes; *c; ++c) {
+            t[static_cast<unsigned char>(*c)] = true;
+        }
+        return t;
+    }();
+    return table;
+}
+
+static void ScanScalar(const char* data, size_t blocks, uint64_t* structural, uint64_t* newlines) {
+    const auto& table = StructuralTable();
+    for (size_t b = 0; b < blocks; ++b) {
+        uint64_t s = 0;
+        uint64_t n = 0;
+        const char* block = data + b * 64;
+        for (size_t i = 0; i < 64; ++i) {
+            unsigned char c = static_cast<unsigned char>(block[i]);
+            s |= static_cast<uint64_t>(table[c]) << i;
+            n |= static_cast<uint64_t>(c == '\n') << i;
+        }
+        structural[b] = s;
+        newlines[b] = n;
+    }
+}
+
+#ifdef MARKDOWN_X86
+
+__attribute__((target("sse2")))
+static void ScanSSE2(const char* data, size_t blocks, uint64_t* structural, uint64_t* newlines) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    __m128i needles[sizeof(kStructuralBytes) - 1];
+    for (size_t k = 0; k < sizeof(kStructuralBytes) - 1; ++k) {
+        needles[k] = _mm_set1_epi8(kStructuralBytes[k]);
+    }
+
+    for (size_t b = 0; b < blocks; ++b) {
+        uint64_t s = 0;
+        uint64_t n = 0;
+        for (size_t lane = 0; lane < 4; ++lane) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + b * 64 + lane * 16));
+            __m128i hits = _mm_setzero_si128();
+            for (const __m128i& needle : needles) {
+                hits = _mm_or_si128(hits, _mm_cmpeq_epi8(chunk, needle));
+            }
+            s |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(hits))) << (lane * 16);
+            n |= static_cast<uint64_t>(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)))) << (lane * 16);
+        }
+        structural[b] = s;
+        newlines[b] = n;
+    }
+}
+
+__attribute__((target("avx2")))
+static void ScanAVX2(const char* data, size_t blocks, uint64_t* structural, uint64_t* newlines) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    __m256i needles[sizeof(kStructuralBytes) - 1];
+    for (size_t k = 0; k < sizeof(kStructuralBytes) - 1; ++k) {
+        needles[k] = _mm256_set1_epi8(kStructuralBytes[k]);
+    }
+
+    for (size_t b = 0; b < blocks; ++b) {
+        uint64_t s = 0;
+        uint64_t n = 0;
+        for (size_t lane = 0; lane < 2; ++lane) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + b * 64 + lane * 32));
+            __m256i hits = _mm256_setzero_si256();
+            for (const __m256i& needle : needles) {
+                hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, needle));
+            }
+            s |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(hits))) << (lane * 32);
+            n |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline)))) << (lane * 32);
+        }
+        structural[b] = s;
+        newlines[b] = n;
+    }
+}
+
+#endif // MARKDOWN_X86
+
+struct SelectedKernel {
+    ScanKernel scan;
+    const char* name;
+};
+
+static const SelectedKernel& Selected() {
+    static const SelectedKernel kernel = []() -> SelectedKernel {
+#ifdef MARKDOWN_X86
+        if (CpuHasAVX2()) {
+            return {ScanAVX2, "avx2"};
+        }
+        if (CpuHasSSE2()) {
+            return {ScanSSE2, "sse2"};
+        }
+#endif
+        return {ScanScalar, "scalar"};
+    }();
+    return kernel;
+}
+
+const char* StructuralIndex::Kernel() {
+    return Selected().name;
+}
+
+StructuralIndex::StructuralIndex(std::string_view input)
+    : length(input.size()),
+      structural((input.size() + 63) / 64),
+      newlines((input.size() + 63) / 64) {
+    size_t fullBlocks = input.size() / 64;
+    Selected().scan(input.data(), fullBlocks, structural.data(), newlines.data());
+
+    size_t tail = input.size() % 64;
+    if (tail != 0) {
+        // Pad the last partial block with spaces so the kernels can stay branch-free.
+        char block[64];
+        std::memset(block, ' ', sizeof(block));
+        std::memcpy(block, input.data() + fullBlocks * 64, tail);
+        Selected().scan(block, 1, &structural[fullBlocks], &newlines[fullBlocks]);
+    }
+}
+
+size_t StructuralIndex::NextSet(const std::vector<uint64_t>& bits, size_t pos, size_t length) {
+    if (pos >= length) {
+        return length;
+    }
+
+    size_t word = pos / 64;
+    uint64_t current = bits[word] & (~uint64_t(0) << (pos % 64));
+
+    while (current == 0) {
+        if (++word == bits.size()) {
+            return length;
+        }
+        current = bits[word];
+    }
+
+    return word * 64 + static_cast<size_t>(__builtin_ctzll(current));
+}
+
+size_t StructuralIndex::NextStructural(size_t pos) const {
+    return NextSet(structural, pos, length);
+}
+
+size_t StructuralIndex::NextNewline(size_t pos) const {
+    return NextSet(newlines, pos, length);
+}
@@ -0,0 +1,218 @@
+#include "worker_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <string>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// Set on pool workers only: which pool and deque the thread belongs to.
+static thread_local const WorkerPool* currentPool = nullptr;
+static thread_local size_t currentWorker = 0;
+
+static size_t CgroupCpuLimit() {
+    // cgroup v2: "<quota> <period>" or "max <period>".
+    std::ifstream v2("/sys/fs/cgroup/cpu.max");
+    if (v2.is_open()) {
+        std::string quota;
+        double period = 0;
+        if (v2 >> quota >> period && quota != "max" && period > 0) {
+            double cpus = std::stod(quota) / period;
+            return static_cast<size_t>(std::max(1.0, std::ceil(cpus)));
+        }
+        return 0;
+    }
+
+    // cgroup v1: quota is -1 when unlimited.
+    std::ifstream quotaFile("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    std::ifstream periodFile("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+    double quota = -1;
+    double period = 0;
+    if (quotaFile >> quota && periodFile >> period && quota > 0 && period > 0) {
+        return static_cast<size_t>(std::max(1.0, std::ceil(quota / period)));
+    }
+    return 0;
+}
+
+size_t WorkerPool::DefaultConcurrency() {
+    size_t cores = std::thread::hardware_concurrency();
+
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        cores = static_cast<size_t>(CPU_COUNT(&set));
+    }
+#endif
+
+    size_t limit = CgroupCpuLimit();
+    if (limit != 0 && (cores == 0 || limit < cores)) {
+        cores = limit;
+    }
+
+    return std::max<size_t>(cores, 1);
+}
+
+WorkerPool::WorkerPool(size_t count) {
+    if (count == 0) {
+        count = DefaultConcurrency();
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < count; ++i) {
+        threads.emplace_back(&WorkerPool::Run, this, i);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    Wait();
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void WorkerPool::Submit(Task task) {
+    size_t target = currentPool == this
+        ? currentWorker
+        : nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+
+    // Counted as unfinished before it can be taken: a worker that reserved an
+    // earlier task may pop this one first, and its Finish() must not let
+    // Wait() return while the earlier task is still queued.
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        ++unfinished;
+    }
+    {
+        std::lock_guard<std::mutex> lock(workers[target]->mutex);
+        workers[target]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        ++queued;
+    }
+    workAvailable.notify_one();
+}
+
+void WorkerPool::Wait() {
+    std::unique_lock<std::mutex> lock(stateMutex);
+    allDone.wait(lock, [this] { return unfinished == 0; });
+}
+
+bool WorkerPool::RunOne() {
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (queued == 0) {
+            return false;
+        }
+        --queued;
+    }
+
+    size_t self = currentPool == this ? currentWorker : 0;
+    Task task;
+    while (!TryTake(self, task)) {
+        std::this_thread::yield();
+    }
+
+    task();
+    Finish();
+    return true;
+}
+
+bool WorkerPool::TryTake(size_t self, Task& task) {
+    {
+        Worker& own = *workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < workers.size(); ++i) {
+        Worker& victim = *workers[(self + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkerPool::Finish() {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    if (--unfinished == 0) {
+        allDone.notify_all();
+    }
+}
+
+void WorkerPool::Run(size_t self) {
+    currentPool = this;
+    currentWorker = self;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(stateMutex);
+            workAvailable.wait(lock, [this] { return stopping || queued > 0; });
+            if (queued == 0) {
+                return;
+            }
+            --queued;
+        }
+
+        // A task is reserved for this worker, but it may sit in another deque.
+        Task task;
+        while (!TryTake(self, task)) {
+            std::this_thread::yield();
+        }
+
+        task();
+        Finish();
+    }
+}
+
+void TaskGroup::Submit(WorkerPool::Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++pending;
+    }
+    pool.Submit([this, task = std::move(task)] {
+        task();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--pending == 0) {
+            done.notify_all();
+        }
+    });
+}
+
+void TaskGroup::Wait() {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (pending == 0) {
+                return;
+            }
+        }
+
+        if (pool.RunOne()) {
+            continue;
+        }
+
+        // Nothing left to help with: the group's tasks are running elsewhere.
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait_for(lock, std::chrono::milliseconds(1), [this] { return pending == 0; });
+    }
+}
@@ -10,13 +10,9 @@ BIN="$SCRIPT_DIR/builds/MarkdownEngine"
 
 TEST_DIR="$SCRIPT_DIR/target"
 
-shopt -s nullglob
-
-FILES=( "$TEST_DIR"/*.md "$TEST_DIR"/*.mdx)
-
-if [ ${#FILES[@]} -eq 0 ]; then
-    echo "No .md or .mdx files found in $TEST_DIR"
+if [ ! -d "$TEST_DIR" ]; then
+    echo "No $TEST_DIR directory to render"
     exit 1
 fi
 
-"$BIN" "${FILES[@]}"
\ No newline at end of file
+"$BIN" --input-dir "$TEST_DIR" --manifest "$SCRIPT_DIR/builds/manifest.json"
\ No newline at end of file
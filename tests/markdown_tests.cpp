@@ -0,0 +1,401 @@
+// Regression tests for the engine, run by ctest:
+//
+//   MarkdownTests [--root DIR]
+//
+// Emphasis goldens, and checks that every way of rendering a document --
+// parallel, lazily lexed, incremental, streamed, through the C interface
+// and through the render server's framing -- gives the same HTML as a plain
+// serial render, plus the build cache's freshness check. Prints each
+// failure and exits with 1 when there was any.
+#include "build_cache.h"
+#include "document_shell.h"
+#include "incremental_renderer.h"
+#include "input_file.h"
+#include "lexer.h"
+#include "markdown.h"
+#include "output_sink.h"
+#include "parser.h"
+#include "render_server.h"
+#include "renderer.h"
+#include "rule_pipeline.h"
+#include "stream_renderer.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#ifndef MARKDOWN_TESTS_ROOT
+#define MARKDOWN_TESTS_ROOT "."
+#endif
+
+static int failures = 0;
+
+static void Expect(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cerr << "FAIL: " << what << "\n";
+        ++failures;
+    }
+}
+
+static void ExpectEqual(const std::string& actual, const std::string& expected, const std::string& what) {
+    if (actual != expected) {
+        std::cerr << "FAIL: " << what << "\n  expected: " << expected << "\n  actual:   " << actual << "\n";
+        ++failures;
+    }
+}
+
+static std::string Render(std::string_view input, WorkerPool* pool = nullptr, size_t threshold = 1 << 20) {
+    BufferSink sink;
+    Renderer(pool, threshold).Render(input, sink);
+    return sink.Take();
+}
+
+// Inputs for the equivalence checks: a sample document plus a generated one
+// that covers every rule and is large enough to be split into chunks. Both
+// stay small, since every incremental edit renders them from scratch.
+static std::vector<std::string> Documents(const std::string& root) {
+    std::vector<std::string> documents;
+    InputFile file;
+    std::string error;
+    if (file.Open(root + "/target/test-1.md", error)) {
+        documents.emplace_back(file.Data());
+    } else {
+        Expect(false, error);
+    }
+
+    std::string generated;
+    for (int i = 0; i < 100; ++i) {
+        generated += "# Section " + std::to_string(i) + "\n\n";
+        generated += "Some *emphasis*, **strong** and ***both***, `code` and a [link](https://example.com/" +
+                     std::to_string(i) + ").\nA second line with snake_case and a * lone star.\n\n";
+        generated += "- first *item*\n- second **item**\n\n1. one\n2. two\n\n";
+        generated += "```\nfenced *not emphasis*\n```\n\n---\n\n";
+    }
+    documents.push_back(std::move(generated));
+    return documents;
+}
+
+static void TestEmphasis() {
+    struct Case {
+        const char* input;
+        const char* html;
+    };
+    // CommonMark delimiter runs: flanking, intraword underscores, the rule
+    // of three and unbalanced runs.
+    const Case cases[] = {
+        {"*a*", "<p><em>a</em></p>\n"},
+        {"_a_", "<p><em>a</em></p>\n"},
+        {"**a**", "<p><strong>a</strong></p>\n"},
+        {"__a__", "<p><strong>a</strong></p>\n"},
+        {"***a***", "<p><em><strong>a</strong></em></p>\n"},
+        {"*a **b** c*", "<p><em>a <strong>b</strong> c</em></p>\n"},
+        {"**a *b* c**", "<p><strong>a <em>b</em> c</strong></p>\n"},
+        {"*foo**bar**baz*", "<p><em>foo<strong>bar</strong>baz</em></p>\n"},
+        {"*(*a*)*", "<p><em>(<em>a</em>)</em></p>\n"},
+        {"**a*", "<p>*<em>a</em></p>\n"},
+        {"*a**", "<p><em>a</em>*</p>\n"},
+        {"__a_", "<p>_<em>a</em></p>\n"},
+        {"*a*b*c*d*", "<p><em>a</em>b<em>c</em>d*</p>\n"},
+        {"_a*b_c*", "<p>_a<em>b_c</em></p>\n"},
+        {"**a**b", "<p><strong>a</strong>b</p>\n"},
+        {"foo*bar*", "<p>foo<em>bar</em></p>\n"},
+        {"foo_bar_", "<p>foo_bar_</p>\n"},
+        {"snake_case_word", "<p>snake_case_word</p>\n"},
+        {"a * b *", "<p>a * b *</p>\n"},
+        {"a**\"foo\"**", "<p>a**&quot;foo&quot;**</p>\n"},
+        {"**foo \"*bar*\" foo**", "<p><strong>foo &quot;<em>bar</em>&quot; foo</strong></p>\n"},
+        {"*a\nb*", "<p><em>a\nb</em></p>\n"},
+        {"*a", "<p>*a</p>\n"},
+        {"`*a*`", "<p><code>*a*</code></p>\n"},
+        {"- *i*", "<ul>\n<li><em>i</em></li>\n</ul>\n"},
+    };
+    for (const Case& c : cases) {
+        ExpectEqual(Render(c.input), c.html, std::string("emphasis: ") + c.input);
+    }
+}
+
+static void TestParallel(const std::vector<std::string>& documents) {
+    WorkerPool pool(4);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        ExpectEqual(Render(documents[i], &pool, 1024), Render(documents[i]),
+                    "parallel render of document " + std::to_string(i));
+    }
+}
+
+static void TestLazyInlines(const std::vector<std::string>& documents) {
+    Lexer lexer;
+    for (size_t i = 0; i < documents.size(); ++i) {
+        std::string eager = Parser().Parse(lexer.Tokenize(documents[i]));
+        std::string lazy = Parser().Parse(lexer.TokenizeBlocks(documents[i]));
+        ExpectEqual(lazy, eager, "lazily lexed document " + std::to_string(i));
+    }
+}
+
+// Random edits made of markdown syntax; after each one the incremental
+// output must equal rendering the edited source from scratch.
+static void TestIncremental(const std::vector<std::string>& documents) {
+    const char* snippets[] = {"\n",   "\n# ", "# ",  "- ",     "\n- ",  "1. ",     "\n2. ", "**", "*",
+                              "_",    "`",    "```", "[a](b)", "[",     "]",       "(",     ")",  "---",
+                              "\n\n", "x",    "  ",  "\t",     "+ ",    "## h\n", "\n---\n"};
+    std::mt19937 random(7);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        IncrementalRenderer incremental;
+        incremental.Load(documents[i]);
+        ExpectEqual(incremental.Html(), Render(documents[i]), "incremental load of document " + std::to_string(i));
+
+        for (int edit = 0; edit < 200; ++edit) {
+            size_t size = incremental.Source().size();
+            size_t offset = random() % (size + 1);
+            size_t removed = random() % 4 == 0 ? 0 : random() % (std::min<size_t>(8, size - offset) + 1);
+            std::string text;
+            for (unsigned k = random() % 3; k > 0; --k) {
+                text += snippets[random() % (sizeof(snippets) / sizeof(*snippets))];
+            }
+            incremental.Apply(offset, removed, text);
+
+            std::string expected = Parser().Parse(Lexer().Tokenize(incremental.Source()));
+            if (incremental.Html() != expected) {
+                Expect(false, "incremental edit " + std::to_string(edit) + " of document " + std::to_string(i));
+                break;
+            }
+        }
+    }
+}
+
+// Feeds input through a pipe, so reads return whatever the writer got to.
+static std::string Stream(const std::string& input, size_t chunkSize, size_t maxBlock) {
+    int fds[2];
+    if (::pipe(fds) != 0) {
+        Expect(false, "pipe");
+        return "";
+    }
+    std::thread writer([&] {
+        for (size_t at = 0; at < input.size();) {
+            ssize_t n = ::write(fds[1], input.data() + at, input.size() - at);
+            if (n <= 0) {
+                break;
+            }
+            at += static_cast<size_t>(n);
+        }
+        ::close(fds[1]);
+    });
+
+    BufferSink sink;
+    std::string error;
+    Expect(StreamRenderer(chunkSize, maxBlock).Render(fds[0], sink, error), "StreamRenderer: " + error);
+    writer.join();
+    ::close(fds[0]);
+    return sink.Take();
+}
+
+static void TestStream(const std::vector<std::string>& documents) {
+    for (size_t chunkSize : {size_t(1), size_t(7), size_t(4096)}) {
+        for (size_t i = 0; i < documents.size(); ++i) {
+            ExpectEqual(Stream(documents[i], chunkSize, StreamRenderer::kDefaultMaxBlock), Render(documents[i]),
+                        "streamed document " + std::to_string(i) + " in chunks of " + std::to_string(chunkSize));
+        }
+    }
+
+    // One long paragraph is cut at line breaks once it outgrows maxBlock;
+    // with no span crossing a line the output is still the same.
+    std::string paragraph;
+    for (int i = 0; i < 200; ++i) {
+        paragraph += "Line " + std::to_string(i) + " with *emphasis*, `code` and a [link](x).\n";
+    }
+    for (size_t maxBlock : {size_t(64), size_t(1000)}) {
+        ExpectEqual(Stream(paragraph, 13, maxBlock), Render(paragraph),
+                    "streamed paragraph cut at " + std::to_string(maxBlock) + " bytes");
+    }
+}
+
+// An output rewritten by anything that does not record an entry, here with
+// the same size, must not count as fresh.
+static void TestBuildCache() {
+    char pattern[] = "/tmp/markdown_tests.XXXXXX";
+    if (::mkdtemp(pattern) == nullptr) {
+        Expect(false, "mkdtemp");
+        return;
+    }
+    std::filesystem::path directory(pattern);
+    std::string output = (directory / "d.html").string();
+    auto write = [&](const char* html) { std::ofstream(output, std::ios::binary | std::ios::trunc) << html; };
+
+    BuildCache cache((directory / "cache").string(), 1);
+    std::string error;
+    Expect(cache.Open(error), "BuildCache::Open: " + error);
+    uint64_t a = cache.Key("# a\n");
+    uint64_t b = cache.Key("# b\n");
+
+    write("<h1>a</h1>\n");
+    Expect(!cache.IsFresh(output, a), "cache: output without an entry");
+    cache.Record(output, a);
+    Expect(cache.IsFresh(output, a), "cache: recorded output");
+    Expect(!cache.IsFresh(output, b), "cache: changed input");
+    Expect(BuildCache((directory / "cache").string(), 2).Key("# a\n") != a, "cache: key covers the configuration");
+
+    write("<h1>b</h1>\n");
+    Expect(!cache.IsFresh(output, a), "cache: output rewritten with the same size");
+
+    write("<h1>a</h1>\n");
+    cache.Record(output, a);
+    cache.Forget(output);
+    Expect(!cache.IsFresh(output, a), "cache: forgotten output");
+
+    std::error_code ec;
+    std::filesystem::remove_all(directory, ec);
+}
+
+static void TestCApi(const std::vector<std::string>& documents) {
+    markdown_context* context = markdown_context_new(2);
+    Expect(context != nullptr, "markdown_context_new");
+    if (context == nullptr) {
+        return;
+    }
+
+    const std::string& document = documents.back();
+    const char* html = nullptr;
+    size_t length = 0;
+    Expect(markdown_render(context, document.data(), document.size(), &html, &length) == MARKDOWN_OK,
+           "markdown_render status");
+    std::string expected = Render(document);
+    ExpectEqual(std::string(html, length), expected, "markdown_render output");
+    Expect(html[length] == '\0', "markdown_render terminates the HTML");
+
+    std::vector<char> small(16);
+    size_t written = 0;
+    Expect(markdown_render_into(context, document.data(), document.size(), small.data(), small.size(), &written) ==
+               MARKDOWN_BUFFER_TOO_SMALL,
+           "markdown_render_into with a small buffer");
+    Expect(written == expected.size(), "markdown_render_into reports the size needed");
+
+    std::vector<char> large(written);
+    Expect(markdown_render_into(context, document.data(), document.size(), large.data(), large.size(), &written) ==
+               MARKDOWN_OK,
+           "markdown_render_into with a large enough buffer");
+    ExpectEqual(std::string(large.data(), written), expected, "markdown_render_into output");
+
+    Expect(markdown_render(nullptr, "", 0, &html, &length) == MARKDOWN_INVALID_ARGUMENT,
+           "markdown_render without a context");
+    markdown_context_free(context);
+}
+
+static void PutU32(std::string& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out += static_cast<char>((value >> shift) & 0xff);
+    }
+}
+
+static uint32_t GetU32(const std::string& in, size_t& at) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4 && at < in.size(); ++i) {
+        value = value << 8 | static_cast<uint8_t>(in[at++]);
+    }
+    return value;
+}
+
+// Sends requests over a pipe and returns everything the server answered.
+static std::string Serve(RenderServer& server, const std::string& requests) {
+    int in[2], out[2];
+    if (::pipe(in) != 0 || ::pipe(out) != 0) {
+        Expect(false, "pipe");
+        return "";
+    }
+    // Requests and responses stay well below the pipe buffer, so neither
+    // side has to be drained while the other is written.
+    Expect(::write(in[1], requests.data(), requests.size()) == static_cast<ssize_t>(requests.size()),
+           "writing requests");
+    ::close(in[1]);
+
+    std::string error;
+    Expect(server.ServeStream(in[0], out[1], error), "ServeStream: " + error);
+    ::close(in[0]);
+    ::close(out[1]);
+
+    std::string responses;
+    char buffer[4096];
+    ssize_t got;
+    while ((got = ::read(out[0], buffer, sizeof(buffer))) > 0) {
+        responses.append(buffer, static_cast<size_t>(got));
+    }
+    ::close(out[0]);
+    return responses;
+}
+
+static void TestServerFraming() {
+    DocumentShell shell;
+    WorkerPool pool(2);
+    const std::string inputs[] = {"# one\n", "*two*\n", "", "- three\n- four\n"};
+
+    RenderServer server(shell, pool);
+    std::string requests;
+    for (const std::string& input : inputs) {
+        PutU32(requests, static_cast<uint32_t>(input.size()));
+        requests += input;
+    }
+    std::string responses = Serve(server, requests);
+    size_t at = 0;
+    for (const std::string& input : inputs) {
+        uint32_t status = GetU32(responses, at);
+        uint32_t length = GetU32(responses, at);
+        Expect(status == static_cast<uint32_t>(ServeStatus::Ok), "server status for \"" + input + "\"");
+        ExpectEqual(responses.substr(at, length), Render(input), "server response for \"" + input + "\"");
+        at += length;
+    }
+    Expect(at == responses.size(), "server responses end after the last frame");
+
+    // An oversized request is answered and ends the connection.
+    RenderServer strict(shell, pool, nullptr, 4);
+    requests.clear();
+    PutU32(requests, 8);
+    requests += "too long";
+    PutU32(requests, 1);
+    requests += "x";
+    responses = Serve(strict, requests);
+    at = 0;
+    Expect(GetU32(responses, at) == static_cast<uint32_t>(ServeStatus::TooLarge), "server status for a large request");
+    at += GetU32(responses, at);
+    Expect(at == responses.size(), "server stops after a large request");
+}
+
+int main(int argc, char** argv) {
+    std::string root = MARKDOWN_TESTS_ROOT;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--root") == 0 && i + 1 < argc) {
+            root = argv[++i];
+        } else {
+            std::cerr << "Usage: MarkdownTests [--root DIR]\n";
+            return 2;
+        }
+    }
+
+    std::vector<std::string> documents = Documents(root);
+    // The goldens are the HTML of the default build; a trimmed rule set
+    // renders some of their syntax as text.
+    if (MARKDOWN_RULE_HEADING && MARKDOWN_RULE_LIST && MARKDOWN_RULE_CODE && MARKDOWN_RULE_LINK && MARKDOWN_RULE_HR &&
+        MARKDOWN_RULE_EMPHASIS) {
+        TestEmphasis();
+    }
+    TestParallel(documents);
+    TestLazyInlines(documents);
+    TestIncremental(documents);
+    TestStream(documents);
+    TestBuildCache();
+    TestCApi(documents);
+    TestServerFraming();
+
+    if (failures > 0) {
+        std::cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    std::cerr << "All checks passed\n";
+    return 0;
+}
@@ -0,0 +1,363 @@
+// Deterministic markdown corpus generator for scale testing.
+//
+//   MarkdownCorpus [--size SIZE] [--seed N] [--shape NAME] [--mix KIND=W,...] [-o FILE]
+//
+// Output stops at the first block boundary at or past SIZE, which takes K,
+// M and G suffixes (powers of 1024). The same seed, shape and mix always
+// produce the same bytes on every platform: the generator has its own PRNG
+// and never uses the standard distributions.
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+enum Kind { Heading, Paragraph, List, OrderedList, Nested, Fence, Rule, KindCount };
+
+static const char* const kKindNames[KindCount] = {
+    "heading", "paragraph", "list", "ordered", "nested", "fence", "hr"};
+
+// Relative block weights and how densely paragraphs use each inline element,
+// in percent of words.
+struct Shape {
+    const char* name;
+    unsigned weights[KindCount];
+    unsigned emphasis;
+    unsigned code;
+    unsigned links;
+};
+
+static const Shape kShapes[] = {
+    // heading, paragraph, list, ordered, nested, fence, hr
+    {"mixed",  {8, 40, 14, 10, 6, 8, 2}, 6, 4, 3},
+    {"prose",  {4, 80, 6, 4, 0, 2, 1}, 4, 1, 1},
+    {"code",   {6, 20, 6, 4, 0, 60, 1}, 2, 25, 1},
+    {"links",  {6, 50, 20, 6, 2, 2, 1}, 3, 2, 30},
+    {"nested", {4, 10, 10, 10, 60, 4, 1}, 6, 4, 3},
+};
+
+// splitmix64: tiny, fast and identical everywhere.
+class Random {
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+
+    uint64_t Next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, bound); the modulo bias is irrelevant here.
+    uint32_t Below(uint32_t bound) { return static_cast<uint32_t>(Next() % bound); }
+    bool Percent(unsigned percent) { return Below(100) < percent; }
+
+private:
+    uint64_t state;
+};
+
+static const char* const kWords[] = {
+    "the", "parser", "reads", "every", "line", "of", "input", "and", "emits", "tokens",
+    "markdown", "renders", "into", "html", "quickly", "while", "keeping", "memory", "small", "for",
+    "large", "documents", "with", "headings", "lists", "code", "links", "a", "block", "is",
+    "split", "at", "boundaries", "so", "threads", "can", "work", "in", "parallel", "on",
+    "chunks", "throughput", "latency", "buffer", "stream", "index", "cache", "node", "tree", "text"};
+constexpr uint32_t kWordCount = sizeof(kWords) / sizeof(kWords[0]);
+
+static const char* const kCodeLines[] = {
+    "for (size_t i = 0; i < n; ++i) {", "    total += values[i] * weight;", "}",
+    "auto doc = lexer.Tokenize(input);", "if (pos >= input.size()) return false;",
+    "std::string html = parser.Parse(doc);", "return a < b && b > c;", "// TODO: handle the tail"};
+constexpr uint32_t kCodeLineCount = sizeof(kCodeLines) / sizeof(kCodeLines[0]);
+
+class Generator {
+public:
+    Generator(const Shape& shape, uint64_t seed, FILE* out) : shape(shape), random(seed), out(out) {
+        for (unsigned weight : shape.weights) {
+            totalWeight += weight;
+        }
+        buffer.reserve(kFlushSize + 4096);
+    }
+
+    bool Generate(uint64_t size) {
+        while (written + buffer.size() < size) {
+            Block(PickKind());
+            if (buffer.size() >= kFlushSize && !Flush()) {
+                return false;
+            }
+        }
+        return Flush();
+    }
+
+private:
+    static constexpr size_t kFlushSize = 1 << 20;
+
+    Kind PickKind() {
+        uint32_t pick = random.Below(totalWeight);
+        for (int kind = 0; kind < KindCount; ++kind) {
+            if (pick < shape.weights[kind]) {
+                return static_cast<Kind>(kind);
+            }
+            pick -= shape.weights[kind];
+        }
+        return Paragraph;
+    }
+
+    std::string_view Word() { return kWords[random.Below(kWordCount)]; }
+
+    // A run of words with inline elements mixed in at the shape's density.
+    void Inline(uint32_t words) {
+        for (uint32_t i = 0; i < words; ++i) {
+            if (i != 0) {
+                buffer += ' ';
+            }
+            if (random.Percent(shape.emphasis)) {
+                const char* marker = random.Percent(50) ? "**" : (random.Percent(50) ? "*" : "_");
+                buffer.append(marker).append(Word()).append(" ").append(Word()).append(marker);
+            } else if (random.Percent(shape.code)) {
+                buffer.append("`").append(Word()).append("()`");
+            } else if (random.Percent(shape.links)) {
+                buffer.append("[").append(Word()).append(" ").append(Word()).append("](https://example.com/");
+                buffer.append(Word()).append(")");
+            } else {
+                buffer.append(Word());
+            }
+        }
+    }
+
+    void Item(std::string_view marker, unsigned depth) {
+        buffer.append(depth * 2, ' ');
+        buffer.append(marker);
+        buffer += ' ';
+        Inline(3 + random.Below(10));
+        buffer += '\n';
+    }
+
+    void Block(Kind kind) {
+        switch (kind) {
+        case Heading:
+            buffer.append(1 + random.Below(6), '#');
+            buffer += ' ';
+            Inline(2 + random.Below(6));
+            buffer += '\n';
+            break;
+
+        case Paragraph: {
+            uint32_t lines = 1 + random.Below(6);
+            for (uint32_t line = 0; line < lines; ++line) {
+                Inline(6 + random.Below(12));
+                buffer += '\n';
+            }
+            break;
+        }
+
+        case List:
+        case OrderedList: {
+            uint32_t items = 2 + random.Below(7);
+            for (uint32_t item = 1; item <= items; ++item) {
+                if (kind == List) {
+                    Item(random.Percent(70) ? "-" : (random.Percent(50) ? "*" : "+"), 0);
+                } else {
+                    Item(std::to_string(item) + ".", 0);
+                }
+            }
+            break;
+        }
+
+        case Nested: {
+            uint32_t items = 3 + random.Below(10);
+            unsigned depth = 0;
+            for (uint32_t item = 1; item <= items; ++item) {
+                Item(depth % 2 == 0 ? "-" : std::to_string(item) + ".", depth);
+                if (depth < 6 && random.Percent(50)) {
+                    ++depth;
+                } else if (depth > 0 && random.Percent(40)) {
+                    --depth;
+                }
+            }
+            break;
+        }
+
+        case Fence: {
+            buffer.append("```\n");
+            uint32_t lines = 2 + random.Below(12);
+            for (uint32_t line = 0; line < lines; ++line) {
+                buffer.append(kCodeLines[random.Below(kCodeLineCount)]).append("\n");
+            }
+            buffer.append("```\n");
+            break;
+        }
+
+        case Rule:
+            buffer.append(random.Percent(50) ? "---\n" : "***\n");
+            break;
+
+        default:
+            break;
+        }
+        buffer += '\n';
+    }
+
+    bool Flush() {
+        if (!buffer.empty() && std::fwrite(buffer.data(), 1, buffer.size(), out) != buffer.size()) {
+            return false;
+        }
+        written += buffer.size();
+        buffer.clear();
+        return true;
+    }
+
+    Shape shape;
+    Random random;
+    FILE* out;
+    unsigned totalWeight = 0;
+    uint64_t written = 0;
+    std::string buffer;
+};
+
+static bool ParseSize(const std::string& text, uint64_t& size) {
+    char* end = nullptr;
+    double value = std::strtod(text.c_str(), &end);
+    if (end == text.c_str() || value < 0) {
+        return false;
+    }
+
+    uint64_t unit = 1;
+    std::string suffix(end);
+    if (suffix == "K" || suffix == "k" || suffix == "KB") {
+        unit = 1ull << 10;
+    } else if (suffix == "M" || suffix == "m" || suffix == "MB") {
+        unit = 1ull << 20;
+    } else if (suffix == "G" || suffix == "g" || suffix == "GB") {
+        unit = 1ull << 30;
+    } else if (!suffix.empty()) {
+        return false;
+    }
+    size = static_cast<uint64_t>(value * static_cast<double>(unit));
+    return true;
+}
+
+// Overrides weights from "kind=weight,kind=weight".
+static bool ParseMix(const std::string& mix, Shape& shape) {
+    size_t pos = 0;
+    while (pos < mix.size()) {
+        size_t end = mix.find(',', pos);
+        if (end == std::string::npos) {
+            end = mix.size();
+        }
+        std::string entry = mix.substr(pos, end - pos);
+        size_t equals = entry.find('=');
+        if (equals == std::string::npos) {
+            return false;
+        }
+
+        std::string name = entry.substr(0, equals);
+        unsigned weight = static_cast<unsigned>(std::strtoul(entry.c_str() + equals + 1, nullptr, 10));
+        bool known = false;
+        for (int kind = 0; kind < KindCount; ++kind) {
+            if (name == kKindNames[kind]) {
+                shape.weights[kind] = weight;
+                known = true;
+            }
+        }
+        if (!known) {
+            return false;
+        }
+        pos = end + 1;
+    }
+    return true;
+}
+
+static void PrintUsage() {
+    std::cerr << "Usage: MarkdownCorpus [--size SIZE] [--seed N] [--shape NAME] [--mix KIND=W,...] [-o FILE]\n"
+                 "  shapes: mixed (default), prose, code, links, nested\n"
+                 "  kinds:  heading, paragraph, list, ordered, nested, fence, hr\n";
+}
+
+int main(int argc, char* argv[]) {
+    uint64_t size = 1 << 20;
+    uint64_t seed = 1;
+    Shape shape = kShapes[0];
+    std::string mix;
+    std::string outputPath;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            PrintUsage();
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            PrintUsage();
+            return 2;
+        }
+        std::string value = argv[++i];
+
+        if (arg == "--size") {
+            if (!ParseSize(value, size)) {
+                std::cerr << "Invalid size: " << value << "\n";
+                return 2;
+            }
+        } else if (arg == "--seed") {
+            seed = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--shape") {
+            bool found = false;
+            for (const Shape& preset : kShapes) {
+                if (value == preset.name) {
+                    shape = preset;
+                    found = true;
+                }
+            }
+            if (!found) {
+                std::cerr << "Unknown shape: " << value << "\n";
+                return 2;
+            }
+        } else if (arg == "--mix") {
+            mix = value;
+        } else if (arg == "-o" || arg == "--output") {
+            outputPath = value;
+        } else {
+            PrintUsage();
+            return 2;
+        }
+    }
+
+    if (!mix.empty() && !ParseMix(mix, shape)) {
+        std::cerr << "Invalid mix: " << mix << "\n";
+        return 2;
+    }
+    unsigned total = 0;
+    for (unsigned weight : shape.weights) {
+        total += weight;
+    }
+    if (total == 0) {
+        std::cerr << "The mix must give at least one kind a weight\n";
+        return 2;
+    }
+
+    FILE* out = stdout;
+    if (!outputPath.empty() && outputPath != "-") {
+        out = std::fopen(outputPath.c_str(), "wb");
+        if (out == nullptr) {
+            std::cerr << "Cannot open " << outputPath << ": " << std::strerror(errno) << "\n";
+            return 1;
+        }
+    }
+
+    Generator generator(shape, seed, out);
+    bool ok = generator.Generate(size);
+    if (std::fflush(out) != 0) {
+        ok = false;
+    }
+    if (out != stdout) {
+        ok = std::fclose(out) == 0 && ok;
+    }
+    if (!ok) {
+        std::cerr << "Write failed: " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    return 0;
+}